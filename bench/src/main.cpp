@@ -0,0 +1,438 @@
+#include "ofMain.h"
+#include "DepthSort.hpp"
+#include "ParticleSystem.hpp"
+#include "Simulation.hpp"
+#include "TerrainGenerator.hpp"
+#include "ThreadPool.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <sys/resource.h>
+
+// Headless benchmark: steps the simulation (no window, no GL, no fish model)
+// for a fixed number of ticks and prints per-boid cost, neighbor checks and
+// peak memory, then times packing the flocks into per instance data the way
+// a frame does before its instanced draws.
+//
+//   boidsBench [--prey N] [--predators N] [--food N] [--steps N] [--seed N]
+//              [--terrain N]   (N x N height samples over the same extent)
+//              [--mesh N]      (1 = hand the terrain over as a triangle
+//                               mesh, Simulation::setCollisionMesh)
+//              [--frames N]    (instance packing / particle passes)
+//              [--particles N] (CPU particle pool, volcano and co.)
+//              [--record FILE] (write the run's inputs, see Replay)
+//              [--replay FILE] (re-run a recording instead, from the app
+//                               or --record, and check it stays bit-exact)
+
+struct BenchOptions {
+  int prey = 5000;
+  int predators = 50;
+  int food = 200;
+  int steps = 600;
+  int seed = 1234;
+  int terrain = 100;
+  int frames = 100;
+  int particles = 100000;
+  int mesh = 0;
+  std::string record, replay;
+};
+
+static BenchOptions parseOptions(int argc, char *argv[]) {
+  BenchOptions options;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    int value = std::atoi(argv[i + 1]);
+    if (!strcmp(argv[i], "--prey")) {
+      options.prey = value;
+    } else if (!strcmp(argv[i], "--predators")) {
+      options.predators = value;
+    } else if (!strcmp(argv[i], "--food")) {
+      options.food = value;
+    } else if (!strcmp(argv[i], "--steps")) {
+      options.steps = value;
+    } else if (!strcmp(argv[i], "--seed")) {
+      options.seed = value;
+    } else if (!strcmp(argv[i], "--terrain")) {
+      options.terrain = std::max(value, 2);
+    } else if (!strcmp(argv[i], "--frames")) {
+      options.frames = std::max(value, 1);
+    } else if (!strcmp(argv[i], "--particles")) {
+      options.particles = std::max(value, 0);
+    } else if (!strcmp(argv[i], "--mesh")) {
+      options.mesh = value;
+    } else if (!strcmp(argv[i], "--record")) {
+      options.record = argv[i + 1];
+    } else if (!strcmp(argv[i], "--replay")) {
+      options.replay = argv[i + 1];
+    } else {
+      cout << "unknown option " << argv[i] << endl;
+    }
+  }
+  return options;
+}
+
+// same terrain ofApp builds with the default sliders, at any resolution
+static HeightField makeHeightField(int resolution, double &milliseconds) {
+  TerrainGenerator::Grid grid;
+  grid.cols = resolution;
+  grid.rows = resolution;
+  grid.step = 50.0f / resolution;
+  grid.scale = 15;
+  TerrainGenerator::Output terrain;
+  auto start = std::chrono::steady_clock::now();
+  TerrainGenerator().generate(grid, TerrainGenerator::Noise(), terrain);
+  milliseconds = std::chrono::duration<double, std::milli>(
+                     std::chrono::steady_clock::now() - start)
+                     .count();
+  return terrain.heightField;
+}
+
+// the baked sign at every sample point over the height field against the
+// height field itself: inside below its surface and above the ceiling.
+// Returns how many disagree out of checked, points within half a unit of
+// either surface are left out
+static int signMismatches(const DistanceField &field,
+                          const HeightField &heightField, int &checked) {
+  const DistanceField::Settings &settings = field.getSettings();
+  glm::vec2 lo = heightField.getOrigin();
+  glm::vec2 hi = lo + glm::vec2(heightField.getCols() - 1,
+                                heightField.getRows() - 1) *
+                          heightField.getSpacing();
+  glm::vec3 cells =
+      (settings.boundsMax - settings.boundsMin) / settings.cellSize;
+  int mismatches = 0;
+  checked = 0;
+  for (int z = 0; z <= (int)cells.z; z++) {
+    for (int x = 0; x <= (int)cells.x; x++) {
+      glm::vec3 p = settings.boundsMin +
+                    glm::vec3(x, 0, z) * settings.cellSize;
+      if (p.x < lo.x || p.x > hi.x || p.z < lo.y || p.z > hi.y) {
+        continue;
+      }
+      float surface = heightField.surface(p.x, p.z);
+      for (int y = 0; y <= (int)cells.y; y++) {
+        p.y = settings.boundsMin.y + y * settings.cellSize;
+        if (fabsf(p.y - surface) < 0.5f ||
+            fabsf(p.y - TERRAIN_CEILING) < 0.5f) {
+          continue;
+        }
+        glm::vec3 gradient;
+        bool inside = p.y < surface || p.y > TERRAIN_CEILING;
+        mismatches += (field.sample(p, gradient) < 0) != inside;
+        checked++;
+      }
+    }
+  }
+  return mismatches;
+}
+
+// Boid::flockingForce against separate, align and cohere as they were before
+// they got fused: three brute force passes over the whole flock, separation
+// weighted 1.3. Up to 1000 boids spread over the flock are checked, returns
+// the largest difference, largest is the largest reference force
+static float flockingDifference(Flock &flock, int &checked, float &largest) {
+  const Boid::KindParams &params = flock.getParams();
+  const BoidSoA &hot = flock.hot;
+  int n = hot.size();
+  flock.grid.build(hot, std::max({params.separationRadius,
+                                  params.alignmentRadius,
+                                  params.cohesionRadius}));
+  auto limit = [&](glm::vec3 steer) {
+    if (glm::length(steer) > params.maxForce) {
+      steer = glm::normalize(steer) * params.maxForce;
+    }
+    return steer;
+  };
+
+  float difference = 0;
+  checked = 0;
+  largest = 0;
+  for (int i = 0; i < n; i += (n + 999) / 1000) {
+    glm::vec3 position = hot.position(i), velocity = hot.velocity(i);
+    glm::vec3 separation(0, 0, 0), alignment(0, 0, 0), cohesion(0, 0, 0);
+    int separationCount = 0, alignmentCount = 0, cohesionCount = 0;
+    for (int j = 0; j < n; j++) {
+      float dist = glm::distance(position, hot.position(j));
+      // two boids on the same spot would be a NaN, the fused pass skips them
+      if (j != i && dist < params.separationRadius && dist > 0) {
+        separation += glm::normalize(position - hot.position(j)) * (1 / dist);
+        separationCount++;
+      }
+    }
+    for (int j = 0; j < n; j++) {
+      float dist = glm::distance(position, hot.position(j));
+      if (j != i && dist < params.alignmentRadius) {
+        alignment += hot.velocity(j);
+        alignmentCount++;
+      }
+    }
+    for (int j = 0; j < n; j++) {
+      float dist = glm::distance(position, hot.position(j));
+      if (j != i && dist < params.cohesionRadius) {
+        cohesion += hot.position(j);
+        cohesionCount++;
+      }
+    }
+    glm::vec3 reference(0, 0, 0);
+    if (separationCount > 0) {
+      reference += limit(glm::normalize(separation) * params.maxSpeed -
+                         velocity) *
+                   1.3f;
+    }
+    if (alignmentCount > 0) {
+      reference += limit(glm::normalize(alignment) * params.maxSpeed - velocity);
+    }
+    if (cohesionCount > 0) {
+      reference += Boid::seek(params, position, cohesion / (float)cohesionCount);
+    }
+
+    glm::vec3 fused =
+        flock.boids[i].flockingForce(params, flock.grid, i, position, velocity);
+    difference = std::max(difference, glm::length(fused - reference));
+    largest = std::max(largest, glm::length(reference));
+    checked++;
+  }
+  return difference;
+}
+
+static Simulation::Params defaultParams() {
+  Simulation::Params params;
+  params.boidParams.preyMaxSpeed = 0.25;
+  params.boidParams.preyMaxForce = 0.10;
+  params.boidParams.predatorMaxSpeed = 0.5;
+  params.boidParams.predatorMaxForce = 0.10;
+  params.boidParams.predatorVisionRadius = 60.0;
+  params.boidParams.preyVisionRadius = 40.0;
+  params.boidParams.interactionRadius = 10.0;
+  params.boidParams.separationRadius = 20.0;
+  params.boidParams.alignmentRadius = 35.0;
+  params.boidParams.cohesionRadius = 35.0;
+  return params;
+}
+
+int main(int argc, char *argv[]) {
+  BenchOptions options = parseOptions(argc, argv);
+
+  Simulation sim;
+  sim.flock.kind = BoidKind::PREY;
+  sim.predators.kind = BoidKind::PREDATOR;
+  sim.food.kind = BoidKind::FOOD;
+  double terrainMs = 0;
+  if (!options.replay.empty()) {
+    // everything, terrain and populations included, comes out of the file
+    if (!sim.replay(options.replay)) {
+      cout << "can't play " << options.replay << endl;
+      return 1;
+    }
+    options.seed = sim.getSeed();
+  } else {
+    sim.setSeed(options.seed);
+    if (!options.record.empty() && !sim.record(options.record)) {
+      cout << "can't record to " << options.record << endl;
+      return 1;
+    }
+    // spawned in the first tick, like the app's
+    sim.spawn(Simulation::PREY, options.prey);
+    sim.spawn(Simulation::PREDATORS, options.predators);
+    sim.spawn(Simulation::FOOD, options.food);
+    sim.setParams(defaultParams());
+    HeightField heightField = makeHeightField(options.terrain, terrainMs);
+    sim.setHeightField(heightField);
+    TriangleMesh mesh = TriangleMesh::fromHeightField(heightField);
+    if (options.mesh) {
+      sim.setCollisionMesh(mesh);
+    }
+    // what the first tick does with them, timed on its own
+    auto start = std::chrono::steady_clock::now();
+    TriangleBVH bvh;
+    bvh.build(mesh);
+    double bvhMs = std::chrono::duration<double, std::milli>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+    start = std::chrono::steady_clock::now();
+    DistanceField field;
+    field.build(bvh, TERRAIN_CEILING, DistanceField::Settings(),
+                ThreadPool::shared());
+    double fieldMs = std::chrono::duration<double, std::milli>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    cout << "terrain bake: " << bvh.numTriangles() << " triangles, BVH "
+         << bvh.numNodes() << " nodes in " << bvhMs << " ms, distance field "
+         << field.numStoredBricks() << " of " << field.numBricks()
+         << " bricks, " << field.getBytes() / 1024 << " KB in " << fieldMs
+         << " ms" << endl;
+    int checked = 0;
+    int mismatches = signMismatches(field, heightField, checked);
+    cout << "distance field sign: " << mismatches << " of " << checked
+         << " samples disagree with the height field" << endl;
+  }
+
+  // the first tick spawns everyone and bakes the terrain (timed on its own
+  // above), a warm up that stays out of the per step numbers
+  if (options.replay.empty()) {
+    sim.step();
+  } else {
+    sim.stepReplay();
+  }
+
+  int flockingChecked = 0;
+  float flockingLargest = 0;
+  float flockingError =
+      flockingDifference(sim.flock, flockingChecked, flockingLargest);
+  cout << "flocking vs three pass reference: largest difference "
+       << flockingError << " over " << flockingChecked
+       << " boids, forces up to " << flockingLargest << endl;
+
+  unsigned long totalChecks = 0;
+  unsigned long boidSteps = 0;
+  auto start = std::chrono::steady_clock::now();
+  auto count = [&] {
+    totalChecks += sim.neighborChecks();
+    boidSteps += sim.flock.boids.size() + sim.predators.boids.size() +
+                 sim.food.boids.size();
+  };
+  if (!options.replay.empty()) {
+    for (options.steps = 0; sim.stepReplay(); options.steps++) {
+      count();
+    }
+  } else {
+    for (int i = 0; i < options.steps; i++) {
+      sim.step();
+      count();
+    }
+  }
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+
+  // what renderScene does for every flock, minus the upload and draw, on
+  // the copies Simulation::publish would hand it
+  Flock *flocks[] = {&sim.flock, &sim.predators, &sim.food};
+  FlockSnapshot snapshots[Simulation::NUM_FLOCKS];
+  for (int f = 0; f < Simulation::NUM_FLOCKS; f++) {
+    flocks[f]->snapshot(snapshots[f]);
+  }
+  vector<InstancedMesh::Instance> instances;
+  size_t packed = 0;
+  start = std::chrono::steady_clock::now();
+  for (int i = 0; i < options.frames; i++) {
+    for (int f = 0; f < Simulation::NUM_FLOCKS; f++) {
+      flocks[f]->packInstances(snapshots[f], 0.5f, instances);
+      packed += instances.size();
+    }
+  }
+  double packSeconds = std::chrono::duration<double>(
+                           std::chrono::steady_clock::now() - start)
+                           .count();
+
+  // the same culled for a camera looking over the box from one side
+  ViewCuller culler;
+  culler.setup(ViewCuller::Settings());
+  glm::vec3 eye(0, 30, 420);
+  culler.update(glm::perspective(glm::radians(60.0f), 16 / 9.0f, 0.1f, 800.0f) *
+                    glm::lookAt(eye, glm::vec3(0, -50, 0), glm::vec3(0, 1, 0)),
+                eye);
+  vector<InstancedMesh::Instance> farInstances;
+  size_t near = 0, far = 0;
+  start = std::chrono::steady_clock::now();
+  for (int i = 0; i < options.frames; i++) {
+    for (int f = 0; f < Simulation::NUM_FLOCKS; f++) {
+      flocks[f]->packInstances(snapshots[f], 0.5f, culler, instances,
+                               farInstances);
+      near += instances.size();
+      far += farInstances.size();
+    }
+  }
+  double cullSeconds = std::chrono::duration<double>(
+                           std::chrono::steady_clock::now() - start)
+                           .count();
+
+  // the app's CPU particle path: a volcano, bubbles and sediment sharing a
+  // pool of --particles, spawning just under what fits once warmed up
+  ParticleSystem particleSystem;
+  particleSystem.setup(options.particles, options.seed);
+  const float particleDt = 1.0f / 60.0f, particleLife = 3;
+  for (int e = 0; e < 3; e++) {
+    ParticleSystem::Emitter emitter;
+    emitter.position = glm::vec3(14, 56, 50) + glm::vec3(e * 50, 0, 0);
+    emitter.radius = e * 20;
+    emitter.rate = options.particles * 0.3f / particleLife;
+    emitter.minLifeTime = particleLife * 0.5f;
+    emitter.maxLifeTime = particleLife * 1.5f;
+    emitter.forces.acceleration = glm::vec3(0, e - 8.0f, 0);
+    particleSystem.addEmitter(emitter);
+  }
+  for (float t = 0; t < particleLife * 1.5f; t += particleDt) {
+    particleSystem.update(particleDt, ThreadPool::shared());
+  }
+  int64_t particlesStepped = 0;
+  start = std::chrono::steady_clock::now();
+  for (int i = 0; i < options.frames; i++) {
+    particlesStepped += particleSystem.getAlive().size();
+    particleSystem.update(particleDt, ThreadPool::shared());
+  }
+  double particleSeconds = std::chrono::duration<double>(
+                               std::chrono::steady_clock::now() - start)
+                               .count();
+
+  // ordering the living particles back to front, as ofApp does before its
+  // blended point draw, from a camera circling the emitters
+  DepthSort particleOrder;
+  start = std::chrono::steady_clock::now();
+  for (int i = 0; i < options.frames; i++) {
+    float angle = i * 0.05f;
+    glm::vec3 eye = glm::vec3(64, 100, 50) +
+                    glm::vec3(sin(angle), 0, cos(angle)) * 300.0f;
+    particleOrder.sort(particleSystem.getParticles(),
+                       particleSystem.getAlive(),
+                       glm::lookAt(eye, glm::vec3(64, 56, 50), glm::vec3(0, 1, 0)),
+                       ThreadPool::shared());
+  }
+  double sortSeconds = std::chrono::duration<double>(
+                           std::chrono::steady_clock::now() - start)
+                           .count();
+  size_t sorted = particleSystem.getAlive().size();
+
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+
+  cout << "prey " << options.prey << " predators " << options.predators
+       << " food " << options.food << " steps " << options.steps << " seed "
+       << options.seed << endl;
+  cout << "alive at end: prey " << sim.flock.boids.size() << " predators "
+       << sim.predators.boids.size() << " food " << sim.food.boids.size()
+       << endl;
+  cout << "terrain " << options.terrain << "x" << options.terrain << " in "
+       << terrainMs << " ms" << endl;
+  cout << "total " << seconds * 1000.0 << " ms, "
+       << seconds * 1e3 / std::max(options.steps, 1) << " ms/step" << endl;
+  cout << "ns/boid/step " << (boidSteps ? seconds * 1e9 / boidSteps : 0)
+       << endl;
+  cout << "neighbor checks/step " << totalChecks / std::max(options.steps, 1)
+       << endl;
+  cout << "instance packing " << packSeconds * 1e3 / options.frames
+       << " ms/frame, " << (packed ? packSeconds * 1e9 / packed : 0)
+       << " ns/instance" << endl;
+  cout << "culled packing " << cullSeconds * 1e3 / options.frames
+       << " ms/frame, " << near / options.frames << " near + "
+       << far / options.frames << " far of " << packed / options.frames
+       << endl;
+  cout << "particles " << particlesStepped / options.frames << " alive of "
+       << options.particles << ", "
+       << particleSeconds * 1e3 / options.frames << " ms/frame, "
+       << (particlesStepped ? particleSeconds * 1e9 / particlesStepped : 0)
+       << " ns/particle" << endl;
+  cout << "depth sort " << sortSeconds * 1e3 / options.frames
+       << " ms/frame, "
+       << (sorted ? sortSeconds * 1e9 / options.frames / sorted : 0)
+       << " ns/particle" << endl;
+  cout << "peak memory " << usage.ru_maxrss / 1024.0 << " MB" << endl;
+  cout << "state hash " << std::hex << sim.stateHash() << std::dec << endl;
+  if (!options.replay.empty()) {
+    if (sim.firstDivergence() < 0) {
+      cout << "replay matches the recording bit for bit" << endl;
+    } else {
+      cout << "replay diverged at tick " << sim.firstDivergence() << endl;
+    }
+  }
+  return 0;
+}
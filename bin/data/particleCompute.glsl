@@ -129,9 +129,12 @@ struct Particle {
 
 layout(std140, binding = 0) buffer particle { Particle p[]; };
 layout(std140, binding = 1) buffer particlesBack { Particle p2[]; };
-layout(local_size_x = 1024, local_size_y = 1, local_size_z = 1) in;
+// ofApp dispatches ceil(count / 256) groups, see PARTICLE_GROUP_SIZE
+layout(local_size_x = 256, local_size_y = 1, local_size_z = 1) in;
 
-uniform float timeLastFrame;
+uniform float dt;          // the real frame time
+uniform float maxLifeTime; // seconds
+uniform int count;         // particles in the buffers, the last group has spare
 uniform float emitterX;
 uniform float emitterY;
 uniform float emitterZ;
@@ -143,9 +146,10 @@ float rand(float min, float max, float seed) {
 
 void main() {
     uint id = gl_GlobalInvocationID.x;
+    if (id >= uint(count)) {
+        return;
+    }
 
-    float maxLifeTime = 3.0;
-    float dt = 0.016;
     vec4 acceleration = vec4(0, -8, 0, 0);
 
     // Check if the particle needs to respawn
@@ -158,15 +162,10 @@ void main() {
             rand(-15, 15, id * 11.0)
         );
         
-        // Update both buffers consistently
+        // p2 is only read, the buffers swap roles every frame (ofApp)
         p[id].pos.xyz = newPos;
-        p2[id].pos.xyz = newPos;
-        
         p[id].vel.xyz = newVel;
-        p2[id].vel.xyz = newVel;
-        
         p[id].pos.w = maxLifeTime;
-        p2[id].pos.w = maxLifeTime;
     } else {
         // Update velocity first (using previous velocity)
         p[id].vel.xyz = p2[id].vel.xyz + acceleration.xyz * dt;
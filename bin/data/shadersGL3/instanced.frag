@@ -0,0 +1,10 @@
+#version 330 core
+
+in vec4 Color;
+
+out vec4 outputColor;
+
+void main() {
+  // flat, same as the fish got from ofSetColor before
+  outputColor = Color;
+}
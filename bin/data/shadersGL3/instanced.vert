@@ -0,0 +1,15 @@
+#version 330 core
+
+// one mesh drawn once per instance, see InstancedMesh
+uniform mat4 modelViewProjectionMatrix;
+
+in vec4 position;
+layout(location = 4) in mat4 instanceTransform; // locations 4 to 7
+layout(location = 8) in vec4 instanceColor;
+
+out vec4 Color;
+
+void main() {
+  Color = instanceColor;
+  gl_Position = modelViewProjectionMatrix * instanceTransform * position;
+}
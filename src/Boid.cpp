@@ -1,396 +1,223 @@
 #include "Boid.hpp"
+#include "InteractionIndex.hpp"
+#include "SteeringKernels.hpp"
 #include "ofColor.h"
 #include "ofGraphics.h"
 #include "quaternion.hpp"
-#include <limits>
 
-glm::mat4 rotateToVector(glm::vec3 v1, glm::vec3 v2) {
-  glm::vec3 axis = glm::cross(v1, v2);
-  glm::quat q = glm::angleAxis(glm::angle(v1, v2), glm::normalize(axis));
-  return glm::toMat4(q);
+void Boid::showCollisionRay(const glm::vec3 &from) const {
+  ofDrawLine(from.x, from.y, from.z, collisionPoint.x, collisionPoint.y,
+             collisionPoint.z);
 }
 
-glm::vec3 rotateVectorRad(const glm::vec3 &vec, float angleRad,
-                          const glm::vec3 &axis) {
-  glm::mat4 rotationMatrix = glm::rotate(glm::mat4(1.0f), angleRad, axis);
-  glm::vec4 rotatedVec = rotationMatrix * glm::vec4(vec, 1.0f);
-  return glm::vec3(rotatedVec);
-}
-
-vector<glm::vec3> Boid::getRays() const {
-  vector<glm::vec3> rays;
-
-  glm::vec3 forward = normalize(velocity) * collisionRadius;
-  rays.push_back(forward);
-
-  // Construct a coordinate basis around the forward vector
-  // Pick an arbitrary "up" vector that's not parallel to velocity
-  glm::vec3 up = abs(dot(velocity, glm::vec3(0, 1, 0))) < 0.99
-                     ? glm::vec3(0, 1, 0)
-                     : glm::vec3(1, 0, 0);
-
-  glm::vec3 right = normalize(glm::cross(velocity, up));
-  glm::vec3 adjustedUp = normalize(glm::cross(velocity, right));
-
-  // Horizontal 45° rays (left and right)
-  float angle45 = PI / 4.0f;
-
-  glm::vec3 left45 =
-      normalize(rotateVectorRad(velocity, +angle45, adjustedUp)) *
-      collisionRadius;
-  glm::vec3 right45 =
-      normalize(rotateVectorRad(velocity, -angle45, adjustedUp)) *
-      collisionRadius;
-  rays.push_back(left45);
-  rays.push_back(right45);
-
-  // Vertical 45° rays (up and down)
-  glm::vec3 up45 =
-      normalize(rotateVectorRad(velocity, -angle45, right)) * collisionRadius;
-  glm::vec3 down45 =
-      normalize(rotateVectorRad(velocity, +angle45, right)) * collisionRadius;
-  rays.push_back(up45);
-  rays.push_back(down45);
-
-  return rays;
-}
-
-void Boid::showRays() {
-  vector<glm::vec3> collisionRays = getRays();
-  for (auto ray : collisionRays) {
-    glm::vec3 end = position + ray;
-    ofDrawLine(position.x, position.y, position.z, end.x, end.y, end.z);
-  }
-}
-
-Boid::Boid() {
-  velocity =
-      glm::vec3(ofRandom(-0.1, 0.1), ofRandom(0, 0), ofRandom(-0.1, 0.1));
-  acceleration =
-      glm::vec3(ofRandom(-0.1, 0.1), ofRandom(-0.1, 0.1), ofRandom(-0.1, 0.1));
-  position =
-      glm::vec3(ofRandom(-300, 300), ofRandom(-50, 0), ofRandom(-300, 300));
-
-  if (ofRandom(1) < 0.5) {
-    // Generate a random shade of orange
-    fishColor.setHsb(ofRandom(20, 40), ofRandom(150, 255), ofRandom(150, 255));
-  } else {
-    // Generate a random shade of blue
-    fishColor.setHsb(ofRandom(190, 210), ofRandom(150, 255),
-                     ofRandom(150, 255));
-  }
+void Boid::randomize(Rng &rng) {
+  // a random shade of orange or of blue
+  float hue = rng.uniform(1) < 0.5 ? rng.uniform(20, 40) : rng.uniform(190, 210);
+  float saturation = rng.uniform(150, 255);
+  float brightness = rng.uniform(150, 255);
+  fishColor.setHsb(hue, saturation, brightness);
 
   oldColor = fishColor;
 }
 
-void Boid::draw(ofx::assimp::Model &model) {
-  model.enableColors();
-
-  ofSetColor(fishColor);
-  if (type == "food") {
-    ofDrawSphere(position, 1);
+void Boid::drawOverlays(const Features &features, const glm::vec3 &position,
+                        const glm::vec3 &velocity) const {
+  if (kind == BoidKind::FOOD || glm::length(velocity) == 0) {
     return;
   }
-  // cout << fishColor << endl;
-  if (glm::length(velocity) > 0) {
-    glm::vec3 dir = glm::normalize(velocity);
-    glm::vec3 coneDir = glm::vec3(0, 0, -1);
 
-    glm::mat4 rotationMatrix = rotateToVector(coneDir, dir);
-    glm::mat4 coneTransform =
-        glm::translate(glm::mat4(1.0f), position) * rotationMatrix;
-    // coneTransform = glm::scale(coneTransform, glm::vec3(0.1, 0.1, 0.1));
-    if (type == "predator") {
-      coneTransform = glm::scale(coneTransform, glm::vec3(2, 2, 2));
-    }
-    
-    ofPushMatrix();
-    ofMultMatrix(coneTransform);
-    model.draw();
-    // ofDrawCone(0, 0, 0, 0.3, 1.0);
-    ofPopMatrix();
-
-    // drawing rays for each boid
-    if (toggleShowRays) {
-      showRays();
-    }
-
-    if (toggleShowSeek) {
-      showSeek();
-    }
-    if (toggleHealth) {
-      ofSetColor(fishColor);
-      ofDrawBitmapString(std::to_string(health), position.x, position.y + 10,
-                     position.z);
-    }
-
-    // set the seek pos
-    if (type == "predator") {
-      ofSetColor(ofColor::green);
-      ofDrawSphere(seekPosition, 1);
-    }
-
-  } else {
-    ofPushMatrix();
-    ofTranslate(position);
-    // model.draw();
-    ofDrawCone(0, 0, 0, 0.3, 1.0);
-    ofPopMatrix();
+  // drawing rays for each boid
+  if (features.enableCollisionRays && hasCollisionPoint) {
+    ofSetColor(fishColor);
+    showCollisionRay(position);
   }
-}
 
-void Boid::update() {
-  velocity += acceleration;
-  if (glm::length(velocity) > maxSpeed) {
-    velocity = glm::normalize(velocity) * maxSpeed;
+  if (features.enableSeekFoodPoint) {
+    showSeek();
+  }
+  if (features.showMeshCollision && hasCollisionPoint) {
+    ofSetColor(ofColor::red);
+    ofDrawSphere(collisionPoint, 0.4);
+  }
+  if (features.showHealth) {
+    ofSetColor(fishColor);
+    ofDrawBitmapString(std::to_string(health), position.x, position.y + 10,
+                       position.z);
   }
-  position += velocity;
-  // bounding position
-  checkEdges();
-
-  acceleration *= 0;
-}
 
-void Boid::setRadii(float sepRadius, float aliRadius, float cohRadius) {
-  separationRadius = sepRadius;
-  alignmentRadius = aliRadius;
-  cohesionRadius = cohRadius;
+  // set the seek pos
+  if (kind == BoidKind::PREDATOR) {
+    ofSetColor(ofColor::green);
+    ofDrawSphere(seekPosition, 1);
+  }
 }
 
-void Boid::applyForce(glm::vec3 force) { acceleration += force; }
-
-glm::vec3 Boid::seek(glm::vec3 target) {
+glm::vec3 Boid::seek(const KindParams &params, const glm::vec3 &position,
+                     glm::vec3 target) {
   glm::vec3 desired = target - position;
-  glm::vec3 steer = glm::normalize(desired) * maxSpeed;
-  if (glm::length(steer) > maxForce) {
-    steer = glm::normalize(steer) * maxForce;
+  glm::vec3 steer = glm::normalize(desired) * params.maxSpeed;
+  if (glm::length(steer) > params.maxForce) {
+    steer = glm::normalize(steer) * params.maxForce;
   }
   return steer;
 }
 
-glm::vec3 Boid::flee(glm::vec3 target) {
+glm::vec3 Boid::flee(const KindParams &params, const glm::vec3 &position,
+                     glm::vec3 target) {
   glm::vec3 desired = -(target - position);
   glm::vec3 steer = glm::normalize(desired) * 0.05;
-  if (glm::length(steer) > maxForce) {
-    steer = glm::normalize(steer) * maxForce;
+  if (glm::length(steer) > params.maxForce) {
+    steer = glm::normalize(steer) * params.maxForce;
   }
   // applyForce(steer);
   return steer;
 }
 
-// Passing in a const reference to ensure correct comparison of boid objects
-glm::vec3 Boid::separate(const vector<Boid> &boids) {
-  float desiredSeparation = separationRadius;
-  glm::vec3 sum = glm::vec3(0, 0, 0);
-  int count = 0;
-  for (auto &other : boids) {
-    float dist = glm::distance(position, other.position);
-    // compares memory addresses to check if they're the same object
-    if (&other != this && dist < desiredSeparation) {
-      glm::vec3 diff = position - other.position;
-      // the closer the other is, the faster you flee
-      diff = glm::normalize(diff) * (1 / dist);
-      sum += diff;
-      count++;
-    }
-  }
-
-  if (count > 0) {
-    sum = glm::normalize(sum) * maxSpeed;
-    glm::vec3 steer = sum - velocity;
-    if (glm::length(steer) > maxForce) {
-      steer = glm::normalize(steer) * maxForce;
-    }
-    return steer;
-  }
-  return glm::vec3(0, 0, 0);
-}
-
 // TODO: only have line of sight of boids in a cone in front
-glm::vec3 Boid::align(const vector<Boid> &boids) {
-  float neighborDistance = alignmentRadius;
-  int count = 0;
-  glm::vec3 sum = glm::vec3(0, 0, 0);
-  for (auto &other : boids) {
-    float dist = glm::distance(position, other.position);
-    if (&other != this && dist < neighborDistance) {
-      sum += other.velocity;
-      count++;
-    }
-  }
-  if (count > 0) {
-    // sum /= boids.size();
-    sum = glm::normalize(sum) * maxSpeed;
-    glm::vec3 steer = sum - velocity;
-    if (glm::length(steer) > maxForce) {
-      steer = glm::normalize(steer) * maxForce;
+glm::vec3 Boid::flockingForce(const KindParams &params,
+                              const SpatialGrid &grid, int index,
+                              const glm::vec3 &position,
+                              const glm::vec3 &velocity) {
+  float sepRadius2 = params.separationRadius * params.separationRadius;
+  float aliRadius2 = params.alignmentRadius * params.alignmentRadius;
+  float cohRadius2 = params.cohesionRadius * params.cohesionRadius;
+  NeighborArrays neighbors = grid.sorted();
+  int self = grid.slotOf(index);
+  FlockingSums sums;
+  neighborChecks = 0;
+  grid.forEachNeighborRange(position, [&](int begin, int end) {
+    accumulateFlocking(neighbors, begin, end, self, position, sepRadius2,
+                       aliRadius2, cohRadius2, sums);
+    neighborChecks += end - begin;
+  });
+
+  auto limit = [&](glm::vec3 steer) {
+    if (glm::length(steer) > params.maxForce) {
+      steer = glm::normalize(steer) * params.maxForce;
     }
     return steer;
+  };
+
+  // the sums can cancel out (or be all zero velocities, like food's), which
+  // normalize would turn into NaNs
+  glm::vec3 force = glm::vec3(0, 0, 0);
+  if (sums.separationCount > 0 && glm::dot(sums.separation, sums.separation) > 0) {
+    force += limit(glm::normalize(sums.separation) * params.maxSpeed -
+                   velocity) *
+             1.3f;
   }
-  return glm::vec3(0, 0, 0);
-}
-
-glm::vec3 Boid::cohere(const vector<Boid> &boids) {
-  float neighborDistance = cohesionRadius;
-  int count = 0;
-  glm::vec3 sum = glm::vec3(0, 0, 0);
-  for (auto &other : boids) {
-    float dist = glm::distance(position, other.position);
-    if (&other != this && dist < neighborDistance) {
-      sum += other.position;
-      count++;
-    }
+  if (sums.alignmentCount > 0 && glm::dot(sums.alignment, sums.alignment) > 0) {
+    force += limit(glm::normalize(sums.alignment) * params.maxSpeed - velocity);
   }
-  if (count > 0) {
-    sum /= count;
-    return seek(sum);
+  if (sums.cohesionCount > 0) {
+    force += seek(params, position, sums.cohesion / (float)sums.cohesionCount);
   }
-  return glm::vec3(0, 0, 0);
+  return force;
 }
 
-glm::vec3 Boid::fleeCollision(std::vector<std::vector<float>> &heightMap) {
-  vector<glm::vec3> collisionRays = getRays();
-  int collisionCount = 0;
-  glm::vec3 collisionPoint = glm::vec3(0, 0, 0);
-  for (auto ray : collisionRays) {
-    glm::vec3 endOfRay = position + ray;
-    if (checkUnderHeightMap(endOfRay, heightMap)) {
-      collisionPoint += endOfRay;
-      collisionCount++;
-    }
+glm::vec3 Boid::fleeCollision(const KindParams &params,
+                              const glm::vec3 &position) const {
+  if (!hasCollisionPoint) {
+    return glm::vec3(0, 0, 0);
   }
-  glm::vec3 fleeCollision = glm::vec3(0, 0, 0);
-  if (collisionCount > 0) {
-    collisionPoint /= collisionCount;
-    if (toggleShowMeshCollision) {
-      ofSetColor(ofColor::red);
-      ofDrawSphere(collisionPoint, 0.4);
-    }
-    fleeCollision = flee(collisionPoint);
-  }
-
-  return fleeCollision;
+  return flee(params, position, collisionPoint);
 }
-void Boid::showSeek() {
+void Boid::showSeek() const {
   ofSetColor(ofColor::green);
   ofDrawSphere(seekPosition, 1);
 }
-void Boid::applyBehaviors(const vector<Boid> &boids,
-                          const vector<Boid> &predators,
-                          const vector<Boid> &prey,
-                          std::vector<std::vector<float>> &heightMap) {
+template <BoidKind K>
+void Boid::applyBehaviors(const KindParams &params, const SpatialGrid &grid,
+                          int index, const InteractionIndex &others,
+                          const glm::vec3 &position, const glm::vec3 &velocity,
+                          glm::vec3 &acceleration) {
 
-  glm::vec3 separation = separate(boids);
-  glm::vec3 alignment = align(boids);
-  glm::vec3 cohesion = cohere(boids);
-  glm::vec3 collision = fleeCollision(heightMap);
+  glm::vec3 flocking = flockingForce(params, grid, index, position, velocity);
+  glm::vec3 collision = fleeCollision(params, position);
 
   glm::vec3 fleePredatorForce = glm::vec3(0, 0, 0);
   glm::vec3 seekPreyForce = glm::vec3(0, 0, 0);
   float healthPercentage = (float)health / maxHealth;
+  InteractionIndex::Neighbor closest;
 
-  if (type == "predator") {
+  if constexpr (K == BoidKind::PREDATOR) {
     health--;
-    if (healthPercentage < 0.8) {
-      glm::vec3 preyLocation = glm::vec3(0, 0, 0);
-      float minDistance = std::numeric_limits<float>::max();
-      for (auto &p : prey) {
-        if (glm::distance(position, p.position) < visionRadius) {
-          preyLocation = p.position;
-          minDistance =
-              std::min(minDistance, glm::distance(position, p.position));
-        }
-      }
-      if (minDistance < std::numeric_limits<float>::max()) {
-        seekPreyForce = seek(preyLocation);
-        seekPosition = preyLocation;
-      }
+    if (healthPercentage < 0.8 &&
+        others.nearest(BoidKind::PREY, position, 1, params.visionRadius,
+                       &closest)) {
+      seekPreyForce = seek(params, position, closest.position);
+      seekPosition = closest.position;
     }
 
-  } else if (type == "prey") { // only happens if it has predators and food
+  } else if constexpr (K == BoidKind::PREY) {
+    // only happens if it has predators and food
     // avoid predators
     health--;
     glm::vec3 predatorLocation = glm::vec3(0, 0, 0);
     int numPredators = 0;
-    for (auto &predator : predators) {
-      if (glm::distance(position, predator.position) < visionRadius) {
-        predatorLocation += predator.position;
-        numPredators++;
-      }
-    }
+    others.forEachInRadius(BoidKind::PREDATOR, position, params.visionRadius,
+                           [&](const glm::vec3 &p, float, int) {
+                             predatorLocation += p;
+                             numPredators++;
+                           });
 
     if (numPredators > 0) {
       predatorLocation /= numPredators;
-      fleePredatorForce = flee(predatorLocation);
+      fleePredatorForce = flee(params, position, predatorLocation);
     }
 
     // Seek Prey (Food)
     if (healthPercentage < 0.8) {
-      separationRadius = interactionRadius;
-      glm::vec3 preyLocation = glm::vec3(0, 0, 0);
-      float minDistance = std::numeric_limits<float>::max();
-      for (auto &p : prey) {
-        if (glm::distance(position, p.position) < visionRadius) {
-          preyLocation = p.position;
-          minDistance =
-              std::min(minDistance, glm::distance(position, p.position));
-        }
-      }
-      if (minDistance < std::numeric_limits<float>::max()) {
-        seekPreyForce = seek(preyLocation);
-        seekPosition = preyLocation;
+      if (others.nearest(BoidKind::FOOD, position, 1, params.visionRadius,
+                         &closest)) {
+        seekPreyForce = seek(params, position, closest.position);
+        seekPosition = closest.position;
       }
     }
   }
 
   // Wandering force
 
-  if (checkUnderHeightMap(position, heightMap)) {
+  if (underHeight) {
     // fishColor = ofColor::red;
     health = 0;
   }
 
-  separation *= 1.3;
-  alignment *= 1;
-  cohesion *= 1;
   collision *= 4;
   fleePredatorForce *= 2.5;
   seekPreyForce *= 2.5;
 
-  applyForce(separation);
-  applyForce(alignment);
-  applyForce(cohesion);
-  applyForce(collision);
-  applyForce(fleePredatorForce);
-  applyForce(seekPreyForce);
+  acceleration += flocking;
+  acceleration += collision;
+  acceleration += fleePredatorForce;
+  acceleration += seekPreyForce;
 }
 
-void Boid::checkEdges() {
-  int BOX_LENGTH = 375;
-  if (position.x > BOX_LENGTH) {
-    position.x = -BOX_LENGTH;
-  } else if (position.x < -BOX_LENGTH) {
-    position.x = BOX_LENGTH;
-  }
-  if (position.y > 0) {
-    position.y = -100;
-  } else if (position.y < -100) {
-    position.y = 0;
-  }
-  if (position.z > BOX_LENGTH) {
-    position.z = -BOX_LENGTH;
-  } else if (position.z < -BOX_LENGTH) {
-    position.z = BOX_LENGTH;
-  }
+template void Boid::applyBehaviors<BoidKind::PREY>(
+    const KindParams &, const SpatialGrid &, int, const InteractionIndex &,
+    const glm::vec3 &, const glm::vec3 &, glm::vec3 &);
+template void Boid::applyBehaviors<BoidKind::PREDATOR>(
+    const KindParams &, const SpatialGrid &, int, const InteractionIndex &,
+    const glm::vec3 &, const glm::vec3 &, glm::vec3 &);
+template void Boid::applyBehaviors<BoidKind::FOOD>(
+    const KindParams &, const SpatialGrid &, int, const InteractionIndex &,
+    const glm::vec3 &, const glm::vec3 &, glm::vec3 &);
+
+const Boid::KindParams &Boid::KindParams::defaults(BoidKind kind) {
+  static const KindParams kinds[NUM_BOID_KINDS] = {
+      {}, // prey
+      {.maxSpeed = 0.2, .maxForce = 0.003, .visionRadius = 50.0}, // predator
+      {.maxSpeed = 0, .maxForce = 0, .visionRadius = 0},          // food
+  };
+  return kinds[(int)kind];
 }
-// cout << "x: " << position.x << " y: " << position.y << " z: " << position.z
-// << endl;
-void Boid::updateParams(const BoidParams &params, const Features &features) {
-  if (type == "prey") {
+
+template <BoidKind K> void Boid::KindParams::set(const BoidParams &params) {
+  if constexpr (K == BoidKind::PREY) {
     maxSpeed = params.preyMaxSpeed;
     maxForce = params.preyMaxForce;
     visionRadius = params.preyVisionRadius;
-  } else if (type == "predator") {
+  } else if constexpr (K == BoidKind::PREDATOR) {
     maxSpeed = params.predatorMaxSpeed;
     maxForce = params.predatorMaxForce;
     visionRadius = params.predatorVisionRadius;
@@ -399,52 +226,38 @@ void Boid::updateParams(const BoidParams &params, const Features &features) {
   separationRadius = params.separationRadius;
   alignmentRadius = params.alignmentRadius;
   cohesionRadius = params.cohesionRadius;
-
-  if (features.enableCollisionRays) {
-    toggleShowRays = true;
-  } else {
-    toggleShowRays = false;
-  }
-  if (features.enableSeekFoodPoint) {
-    toggleShowSeek = true;
-  } else {
-    toggleShowSeek = false;
-  }
-  if (features.showMeshCollision) {
-    toggleShowMeshCollision = true;
-  } else {
-    toggleShowMeshCollision = false;
-  }
-  if (features.showHealth) {
-    toggleHealth = true;
-  } else {
-    toggleHealth = false;
-  }
 }
 
-bool Boid::checkUnderHeightMap(glm::vec3 pos,
-                               std::vector<std::vector<float>> &heightMap) {
-  int boidMin = -375;
-  int boidMax = 375;
-  int heightRangeMin = 0;
-  int heightRangeMax = 99;
-
-  int x = ofMap(pos.x, boidMin, boidMax, heightRangeMin, heightRangeMax); // x
-  int z = ofMap(pos.z, boidMin, boidMax, heightRangeMin, heightRangeMax); // x
-  x = ofClamp(x, 0, heightMap[0].size() - 1);
-  z = ofClamp(z, 0, heightMap.size() - 1);
-
-  if (pos.y <= heightMap[z][x] || pos.y >= 5) {
-    return true;
-  }
-  return false;
-}
-
-void Boid::checkInteraction(vector<Boid> &predators) {
-  for (auto predator : predators) {
-    if (glm::distance(position, predator.position) < interactionRadius) {
+template void Boid::KindParams::set<BoidKind::PREY>(const BoidParams &);
+template void Boid::KindParams::set<BoidKind::PREDATOR>(const BoidParams &);
+template void Boid::KindParams::set<BoidKind::FOOD>(const BoidParams &);
+
+template <BoidKind K>
+void Boid::checkInteraction(const KindParams &params,
+                            const InteractionIndex &others,
+                            const glm::vec3 &position) {
+  if constexpr (K == BoidKind::PREY) {
+    if (others.anyInRadius(BoidKind::PREDATOR, position,
+                           params.interactionRadius)) {
+      health = 0;
+    }
+  } else if constexpr (K == BoidKind::FOOD) {
+    if (others.anyInRadius(BoidKind::PREY, position,
+                           params.interactionRadius)) {
       health = 0;
     }
-    predator.health += 2000;
   }
-}
\ No newline at end of file
+}
+
+template void
+Boid::checkInteraction<BoidKind::PREY>(const KindParams &,
+                                       const InteractionIndex &,
+                                       const glm::vec3 &);
+template void
+Boid::checkInteraction<BoidKind::PREDATOR>(const KindParams &,
+                                           const InteractionIndex &,
+                                           const glm::vec3 &);
+template void
+Boid::checkInteraction<BoidKind::FOOD>(const KindParams &,
+                                       const InteractionIndex &,
+                                       const glm::vec3 &);
@@ -2,12 +2,21 @@
 
 #include "of3dPrimitives.h"
 #include "ofMain.h" // why?
-#include "ofxAssimpModel.h"
+#include "BoidKind.hpp"
+#include "Rng.hpp"
+#include "SpatialGrid.hpp"
 // #include "Flock.hpp"
 
+class InteractionIndex;
+
+// What a boid has besides its position, velocity and acceleration, which
+// are in its Flock's BoidSoA at the same index (see Flock::hot). Steering
+// reads those and gets them handed in.
 class Boid {
 public:
-  Boid();
+  // a random color, drawn from rng (a fresh boid's motion is drawn by
+  // Flock::generateFlock)
+  void randomize(Rng &rng);
   struct BoidParams {
     float preyMaxSpeed;
     float preyMaxForce;
@@ -26,57 +35,75 @@ public:
     bool showMeshCollision;
     bool showHealth;
   };
-  void draw(ofx::assimp::Model &model);
-  void update();
-  glm::vec3 seek(glm::vec3 target);
-  glm::vec3 flee(glm::vec3 target);
-  void applyForce(glm::vec3 f);
-  void setRadii(float sepRadius, float aliRadius, float cohRadius);
-  void showRays();
-  void showSeek();
-  
-  void updateParams(const BoidParams &params, const Features &features);
-  glm::vec3 separate(const vector<Boid> &boids);
-  glm::vec3 align(const vector<Boid> &boids);
-  glm::vec3 cohere(const vector<Boid> &boids);
-  glm::vec3 fleeCollision(std::vector<std::vector<float>> &heightMap);
-  void applyBehaviors(const vector<Boid> &boids, const vector<Boid> &predators,
-                      const vector<Boid> &prey,
-                      std::vector<std::vector<float>> &heightMap);
-  bool checkUnderHeightMap(glm::vec3 pos,
-                           std::vector<std::vector<float>> &heightMap);
-  void checkEdges();
-  vector<glm::vec3> getRays() const;
-  void checkInteraction(vector<Boid> &predators);
+  // what every boid of one kind steers by. Each Flock keeps one and hands it
+  // to its boids, so a slider moving doesn't touch any of them
+  struct KindParams {
+    float maxSpeed = 0.1;
+    float maxForce = 0.005;
+    // predators use it to detect prey, prey to detect predators and find food
+    float visionRadius = 30.0;
+    float interactionRadius = 5.0; // same for everyone, detect if 2 touched
+    float separationRadius = 20.0;
+    float alignmentRadius = 35.0;
+    float cohesionRadius = 35.0;
 
-  float collisionRadius = 15.0f; // how far the rays are cast
+    bool operator==(const KindParams &) const = default;
+    // what a flock of kind starts with, until the sliders come in
+    static const KindParams &defaults(BoidKind kind);
+    // the sliders that apply to kind K, the rest stays
+    template <BoidKind K> void set(const BoidParams &params);
+  };
+  // rays, seek target, health, whatever features asks for. The fish itself
+  // is drawn instanced (see Flock::packInstances). position is where it's
+  // drawn this frame (see FlockSnapshot::interpolatedPosition)
+  void drawOverlays(const Features &features, const glm::vec3 &position,
+                    const glm::vec3 &velocity) const;
+  // params are this boid's kind's and position / velocity its own,
+  // everywhere below
+  static glm::vec3 seek(const KindParams &params, const glm::vec3 &position,
+                        glm::vec3 target);
+  static glm::vec3 flee(const KindParams &params, const glm::vec3 &position,
+                        glm::vec3 target);
+  // a line to collisionPoint, what fleeCollision steers away from
+  void showCollisionRay(const glm::vec3 &from) const;
+  void showSeek() const;
 
-  glm::vec3 position;
-  glm::vec3 velocity;
-  glm::vec3 acceleration;
-  glm::vec3 seekPosition;
-  float maxSpeed = 0.1;
-  float maxForce = 0.005;
-  ofColor fishColor;
-  bool underHeight = false;
-  ofColor oldColor;
-  std::string type = "prey";
+  // separation, alignment and cohesion (weighted) in a single sweep over the
+  // grid's sorted arrays, index is this boid's index in the flock and grid
+  // has to be built over the flock (see SpatialGrid::build)
+  glm::vec3 flockingForce(const KindParams &params, const SpatialGrid &grid,
+                          int index, const glm::vec3 &position,
+                          const glm::vec3 &velocity);
+  // flee from collisionPoint, if the terrain is within collisionRadius
+  glm::vec3 fleeCollision(const KindParams &params,
+                          const glm::vec3 &position) const;
+  // adds this tick's steering to acceleration. collisionPoint,
+  // hasCollisionPoint and underHeight have to be filled in from the terrain's
+  // DistanceField first (see Flock::step), K is this boid's kind. others
+  // holds every kind, built at the start of the tick (see Simulation::step)
+  template <BoidKind K>
+  void applyBehaviors(const KindParams &params, const SpatialGrid &grid,
+                      int index, const InteractionIndex &others,
+                      const glm::vec3 &position, const glm::vec3 &velocity,
+                      glm::vec3 &acceleration);
+  // prey touching a predator and food touching prey die
+  template <BoidKind K>
+  void checkInteraction(const KindParams &params,
+                        const InteractionIndex &others,
+                        const glm::vec3 &position);
 
-  bool toggleShowRays = false;
-  bool toggleShowSeek = false;
-  bool toggleShowMeshCollision = false;
-  bool toggleHealth = false;
+  // terrain closer than this is fled from
+  static constexpr float collisionRadius = 15.0f;
 
-  float visionRadius =
-      30.0; // vision for prety and predator are different. predator uses it to
-            // detect prey, and prey uses it to detect predators and find food
-  float interactionRadius =
-      5.0; // same for everyone, detect if 2 things tougched
+  glm::vec3 seekPosition = glm::vec3(0, 0, 0);
+  glm::vec3 collisionPoint = glm::vec3(0, 0, 0); // nearest point of the terrain
+  int neighborChecks = 0;   // boids flockingForce looked at last time
+  bool hasCollisionPoint = false;
+  ofColor fishColor;
+  bool underHeight = false; // inside the terrain, dies this step
+  ofColor oldColor;
+  BoidKind kind = BoidKind::PREY;
 
   int health = 10000;
   int maxHealth = 10000;
-
-  float separationRadius = 20.0; // Default separation radius
-  float alignmentRadius = 35.0;  // Default alignment radius
-  float cohesionRadius = 35.0;   // Default cohesion radius
 };
\ No newline at end of file
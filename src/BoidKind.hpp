@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <type_traits>
+
+// What a boid is. A flock only ever holds one kind, so code that behaves
+// differently per kind switches once per flock (see dispatchKind) and runs a
+// loop compiled for that kind, rather than comparing every boid.
+enum class BoidKind : uint8_t { PREY, PREDATOR, FOOD };
+static constexpr int NUM_BOID_KINDS = 3;
+
+// the per kind constants that aren't behavior
+struct BoidKindTraits {
+  float drawSize; // scale the mesh is drawn at
+  bool turns;     // drawn facing its velocity, food is a sphere
+};
+
+static constexpr BoidKindTraits boidKindTraits[NUM_BOID_KINDS] = {
+    {1, true},  // prey
+    {2, true},  // predator
+    {1, false}, // food
+};
+
+inline const BoidKindTraits &traitsOf(BoidKind kind) {
+  return boidKindTraits[(int)kind];
+}
+
+template <BoidKind K> using BoidKindTag = std::integral_constant<BoidKind, K>;
+
+// calls fn(BoidKindTag<kind>()), fn's body sees the kind as a compile time
+// constant (decltype(tag)::value) and gets compiled once per kind
+template <typename Fn> decltype(auto) dispatchKind(BoidKind kind, Fn &&fn) {
+  switch (kind) {
+  case BoidKind::PREDATOR:
+    return fn(BoidKindTag<BoidKind::PREDATOR>());
+  case BoidKind::FOOD:
+    return fn(BoidKindTag<BoidKind::FOOD>());
+  default:
+    return fn(BoidKindTag<BoidKind::PREY>());
+  }
+}
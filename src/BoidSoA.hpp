@@ -0,0 +1,54 @@
+#pragma once
+
+#include "ofMain.h"
+#include <cstddef>
+#include <vector>
+
+// Hot per-boid state in structure-of-arrays layout, the only copy of it: the
+// steering and integration kernels stream the plain float arrays. Everything
+// else (color, health, kind) is on Boid, kept in the same order (see Flock),
+// and what a whole kind shares on its Flock.
+struct BoidSoA {
+  std::vector<float> px, py, pz;
+  std::vector<float> vx, vy, vz;
+  std::vector<float> ax, ay, az;
+  std::vector<float> ox, oy, oz; // position before the last integration step
+
+  void push_back(const glm::vec3 &position, const glm::vec3 &velocity,
+                 const glm::vec3 &acceleration) {
+    px.push_back(position.x);
+    py.push_back(position.y);
+    pz.push_back(position.z);
+    vx.push_back(velocity.x);
+    vy.push_back(velocity.y);
+    vz.push_back(velocity.z);
+    ax.push_back(acceleration.x);
+    ay.push_back(acceleration.y);
+    az.push_back(acceleration.z);
+    ox.push_back(position.x);
+    oy.push_back(position.y);
+    oz.push_back(position.z);
+  }
+  // the last boid moves into i, same as EntityPool's swap-and-pop
+  void removeAt(size_t i) {
+    for (auto *v : {&px, &py, &pz, &vx, &vy, &vz, &ax, &ay, &az, &ox, &oy,
+                    &oz}) {
+      (*v)[i] = v->back();
+      v->pop_back();
+    }
+  }
+  size_t size() const { return px.size(); }
+
+  glm::vec3 position(size_t i) const { return glm::vec3(px[i], py[i], pz[i]); }
+  glm::vec3 velocity(size_t i) const { return glm::vec3(vx[i], vy[i], vz[i]); }
+  glm::vec3 previousPosition(size_t i) const {
+    return glm::vec3(ox[i], oy[i], oz[i]);
+  }
+};
+
+// read-only view of neighbor positions/velocities (e.g. the grid's
+// cell-sorted copy)
+struct NeighborArrays {
+  const float *px, *py, *pz;
+  const float *vx, *vy, *vz;
+};
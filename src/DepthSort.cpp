@@ -0,0 +1,67 @@
+#include "DepthSort.hpp"
+#include <limits>
+
+void DepthSort::sort(const Particle *particles,
+                     const vector<uint32_t> &indices, const glm::mat4 &view,
+                     ThreadPool &pool) {
+  int count = indices.size();
+  int numChunks = (count + CHUNK - 1) / CHUNK;
+  depths.resize(count);
+  keys.resize(count);
+  order.resize(count);
+  counts.resize(numChunks * BUCKETS);
+  chunkNear.resize(numChunks);
+  chunkFar.resize(numChunks);
+  if (count == 0) {
+    return;
+  }
+
+  // depth in front of the camera is -z in eye space, only that row matters
+  glm::vec4 row = -glm::vec4(view[0][2], view[1][2], view[2][2], view[3][2]);
+  pool.parallelFor(count, CHUNK, [&](int begin, int end) {
+    float nearest = std::numeric_limits<float>::max();
+    float farthest = std::numeric_limits<float>::lowest();
+    for (int i = begin; i < end; i++) {
+      const glm::vec4 &p = particles[indices[i]].pos;
+      float depth = row.x * p.x + row.y * p.y + row.z * p.z + row.w;
+      depths[i] = depth;
+      nearest = std::min(nearest, depth);
+      farthest = std::max(farthest, depth);
+    }
+    chunkNear[begin / CHUNK] = nearest;
+    chunkFar[begin / CHUNK] = farthest;
+  });
+  float nearest = *std::min_element(chunkNear.begin(), chunkNear.end());
+  float farthest = *std::max_element(chunkFar.begin(), chunkFar.end());
+  float scale = farthest > nearest ? (BUCKETS - 1) / (farthest - nearest) : 0;
+
+  // keys and a histogram per chunk
+  pool.parallelFor(count, CHUNK, [&](int begin, int end) {
+    uint32_t *histogram = &counts[begin / CHUNK * BUCKETS];
+    std::fill(histogram, histogram + BUCKETS, 0);
+    for (int i = begin; i < end; i++) {
+      int key = (int)((farthest - depths[i]) * scale);
+      key = std::min(std::max(key, 0), BUCKETS - 1); // rounding at the ends
+      keys[i] = key;
+      histogram[key]++;
+    }
+  });
+
+  // bucket by bucket, chunk by chunk, counts become where each one starts
+  uint32_t offset = 0;
+  for (int bucket = 0; bucket < BUCKETS; bucket++) {
+    for (int chunk = 0; chunk < numChunks; chunk++) {
+      uint32_t &c = counts[chunk * BUCKETS + bucket];
+      uint32_t n = c;
+      c = offset;
+      offset += n;
+    }
+  }
+
+  pool.parallelFor(count, CHUNK, [&](int begin, int end) {
+    uint32_t *next = &counts[begin / CHUNK * BUCKETS];
+    for (int i = begin; i < end; i++) {
+      order[next[keys[i]]++] = indices[i];
+    }
+  });
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "ParticleKernels.hpp"
+#include "ThreadPool.hpp"
+#include "ofMain.h"
+
+// Orders particles back to front for alpha blending without a comparison
+// sort. View depths are quantized into BUCKETS buckets between this frame's
+// nearest and farthest particle and counting sorted: every chunk of the
+// input histograms its own keys, one prefix sum over (bucket, chunk) gives
+// each chunk its place in every bucket, and the chunks scatter in parallel.
+// Particles in the same bucket keep their input order, so the result doesn't
+// depend on the thread count. Linear in the particle count, three passes.
+class DepthSort {
+public:
+  static constexpr int BUCKETS = 4096; // depth resolution, (far - near) / 4096
+  static constexpr int CHUNK = 65536;  // indices per parallelFor chunk
+
+  // sorts indices (into particles) by depth along view's -z, farthest first.
+  // view is the world to eye matrix (OpenGL convention)
+  void sort(const Particle *particles, const vector<uint32_t> &indices,
+            const glm::mat4 &view, ThreadPool &pool);
+
+  // indices of the last sort(), back to front
+  const vector<uint32_t> &getOrder() const { return order; }
+
+private:
+  vector<float> depths;      // per input index
+  vector<uint16_t> keys;     // bucket per input index, 0 is the farthest
+  vector<uint32_t> counts;   // BUCKETS per chunk, then where the chunk writes
+  vector<float> chunkNear, chunkFar;
+  vector<uint32_t> order;
+};
@@ -0,0 +1,144 @@
+#include "DistanceField.hpp"
+
+static constexpr int S = DistanceField::BRICK_SIDE;
+static constexpr int16_t FAR = 32767; // +maxDistance
+
+void DistanceField::clear() {
+  brickTable.clear();
+  samples.clear();
+  bricksX = bricksY = bricksZ = 0;
+}
+
+void DistanceField::build(const TriangleBVH &mesh, float ceiling,
+                          const Settings &settings, ThreadPool &pool) {
+  clear();
+  this->settings = settings;
+  glm::vec3 cells = (settings.boundsMax - settings.boundsMin) /
+                    settings.cellSize;
+  bricksX = std::max((int)ceilf(cells.x / BRICK), 1);
+  bricksY = std::max((int)ceilf(cells.y / BRICK), 1);
+  bricksZ = std::max((int)ceilf(cells.z / BRICK), 1);
+  invCellSize = glm::vec3(1, 1, 1) / settings.cellSize;
+  // the last cell's far corner would need the next brick, stay just short
+  maxCell = glm::vec3(bricksX, bricksY, bricksZ) * (float)BRICK -
+            glm::vec3(1e-3f);
+  toDistance = settings.maxDistance / FAR;
+
+  // every brick bakes into a slot of its own, then the ones worth keeping
+  // are packed in brick order, so the result doesn't depend on scheduling
+  int numBricks = bricksX * bricksY * bricksZ;
+  brickTable.assign(numBricks, ALL_OUTSIDE);
+  vector<int16_t> baked((size_t)numBricks * BRICK_SAMPLES);
+  vector<uint8_t> kept(numBricks);
+  pool.parallelFor(numBricks, 1, [&](int begin, int end) {
+    for (int b = begin; b < end; b++) {
+      int bx = b % bricksX, by = b / bricksX % bricksY,
+          bz = b / (bricksX * bricksY);
+      bool inside = false;
+      kept[b] = bakeBrick(mesh, ceiling, bx, by, bz,
+                          &baked[(size_t)b * BRICK_SAMPLES], inside);
+      brickTable[b] = inside ? ALL_INSIDE : ALL_OUTSIDE;
+    }
+  });
+  int stored = 0;
+  for (int b = 0; b < numBricks; b++) {
+    if (kept[b]) {
+      std::copy_n(&baked[(size_t)b * BRICK_SAMPLES], BRICK_SAMPLES,
+                  &baked[(size_t)stored * BRICK_SAMPLES]);
+      brickTable[b] = stored++;
+    }
+  }
+  samples.assign(baked.begin(), baked.begin() + (size_t)stored * BRICK_SAMPLES);
+}
+
+bool DistanceField::bakeBrick(const TriangleBVH &mesh, float ceiling, int bx,
+                              int by, int bz, int16_t *out,
+                              bool &inside) const {
+  float brickSize = BRICK * settings.cellSize;
+  glm::vec3 origin =
+      settings.boundsMin + glm::vec3(bx, by, bz) * brickSize;
+
+  // nothing within maxDistance of any sample: one inside test for the lot
+  glm::vec3 center = origin + glm::vec3(brickSize / 2);
+  float brickReach = settings.maxDistance + brickSize * 0.8660254f; // sqrt(3)/2
+  TriangleBVH::Hit hit;
+  if (fabsf(center.y - ceiling) > brickReach &&
+      !mesh.nearest(center, brickReach, hit)) {
+    inside = center.y >= ceiling || mesh.inside(center);
+    return false;
+  }
+
+  bool uniform = true;
+  vector<float> ts;
+  for (int z = 0; z < S; z++) {
+    for (int x = 0; x < S; x++) {
+      // which samples of this column are inside, from one ray up
+      glm::vec3 bottom =
+          origin + glm::vec3(x, 0, z) * settings.cellSize;
+      mesh.crossings(bottom, ts);
+      std::sort(ts.begin(), ts.end());
+      // a distance is at most the one below it plus the step between them,
+      // which narrows each search after the first
+      float reach = settings.maxDistance;
+      for (int y = 0; y < S; y++) {
+        float height = y * settings.cellSize;
+        glm::vec3 p = bottom + glm::vec3(0, height, 0);
+        size_t above =
+            ts.end() - std::upper_bound(ts.begin(), ts.end(), height);
+        float distance =
+            mesh.nearest(p, reach, hit) ? hit.t : settings.maxDistance;
+        reach = std::min(distance + settings.cellSize * 1.001f,
+                         settings.maxDistance);
+        if (above % 2 == 1) {
+          distance = -distance;
+        }
+        distance = std::min(distance, ceiling - p.y); // the water surface
+        float q = std::clamp(distance / settings.maxDistance, -1.0f, 1.0f);
+        int16_t value = (int16_t)lroundf(q * FAR);
+        out[(z * S + y) * S + x] = value;
+        uniform = uniform && value == out[0] && (value == FAR || value == -FAR);
+      }
+    }
+  }
+  if (uniform) {
+    inside = out[0] < 0;
+    return false;
+  }
+  return true;
+}
+
+float DistanceField::sample(const glm::vec3 &point,
+                            glm::vec3 &gradient) const {
+  glm::vec3 f = glm::clamp((point - settings.boundsMin) * invCellSize,
+                           glm::vec3(0, 0, 0), maxCell);
+  int cx = (int)f.x, cy = (int)f.y, cz = (int)f.z;
+  int bx = cx / BRICK, by = cy / BRICK, bz = cz / BRICK;
+  int32_t brick = brickTable[(bz * bricksY + by) * bricksX + bx];
+  if (brick < 0) {
+    gradient = glm::vec3(0, 0, 0);
+    return brick == ALL_OUTSIDE ? settings.maxDistance
+                                : -settings.maxDistance;
+  }
+  float tx = f.x - cx, ty = f.y - cy, tz = f.z - cz;
+  const int16_t *s =
+      &samples[(size_t)brick * BRICK_SAMPLES +
+               ((cz - bz * BRICK) * S + (cy - by * BRICK)) * S +
+               (cx - bx * BRICK)];
+  float c000 = s[0], c100 = s[1], c010 = s[S], c110 = s[S + 1];
+  float c001 = s[S * S], c101 = s[S * S + 1], c011 = s[S * S + S],
+        c111 = s[S * S + S + 1];
+
+  // trilinear, and its derivative along each axis from the same corners
+  float c00 = c000 + (c100 - c000) * tx, c10 = c010 + (c110 - c010) * tx;
+  float c01 = c001 + (c101 - c001) * tx, c11 = c011 + (c111 - c011) * tx;
+  float c0 = c00 + (c10 - c00) * ty, c1 = c01 + (c11 - c01) * ty;
+  float dx = (c100 - c000) * (1 - ty) * (1 - tz) +
+             (c110 - c010) * ty * (1 - tz) + (c101 - c001) * (1 - ty) * tz +
+             (c111 - c011) * ty * tz;
+  float dy = (c10 - c00) * (1 - tz) + (c11 - c01) * tz;
+  float dz = c1 - c0;
+  glm::vec3 d(dx, dy, dz);
+  float length2 = glm::dot(d, d);
+  gradient = length2 > 0 ? d / sqrtf(length2) : glm::vec3(0, 0, 0);
+  return (c0 + (c1 - c0) * tz) * toDistance;
+}
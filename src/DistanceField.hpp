@@ -0,0 +1,70 @@
+#pragma once
+
+#include "ThreadPool.hpp"
+#include "TriangleBVH.hpp"
+#include "ofMain.h"
+
+// everything at or above this height counts as solid too (the water surface)
+constexpr float TERRAIN_CEILING = 5.0f;
+
+// The terrain baked into a signed distance field, so avoiding it costs one
+// trilinear lookup per boid instead of a handful of rays. Distance is
+// positive in the water and negative inside the terrain or above the
+// ceiling, clamped to +-maxDistance and stored as 16 bits. The samples sit
+// in bricks of BRICK^3 cells, each with its far faces duplicated so a
+// lookup never leaves its brick; bricks that are all the way out (or in)
+// aren't stored at all, which leaves little more than a shell around the
+// surface. Read only once built.
+class DistanceField {
+public:
+  static constexpr int BRICK = 8;               // cells per brick side
+  static constexpr int BRICK_SIDE = BRICK + 1;  // samples per brick side
+  static constexpr int BRICK_SAMPLES = BRICK_SIDE * BRICK_SIDE * BRICK_SIDE;
+
+  struct Settings {
+    // the boids' box (see SpatialGrid) grown by maxDistance, points outside
+    // read the nearest edge
+    glm::vec3 boundsMin = glm::vec3(-390, -115, -390);
+    glm::vec3 boundsMax = glm::vec3(390, 15, 390);
+    float cellSize = 5;
+    float maxDistance = 15; // Boid::collisionRadius, nothing further matters
+  };
+
+  // exact distances to mesh's triangles and to the plane y = ceiling, a
+  // brick per parallelFor chunk
+  void build(const TriangleBVH &mesh, float ceiling, const Settings &settings,
+             ThreadPool &pool);
+  void clear();
+
+  bool empty() const { return brickTable.empty(); }
+
+  // signed distance at point, and its gradient (the way out of the terrain,
+  // unit length wherever the field isn't flat)
+  float sample(const glm::vec3 &point, glm::vec3 &gradient) const;
+
+  const Settings &getSettings() const { return settings; }
+  int numBricks() const { return brickTable.size(); }
+  int numStoredBricks() const { return samples.size() / BRICK_SAMPLES; }
+  size_t getBytes() const {
+    return brickTable.size() * sizeof(int32_t) +
+           samples.size() * sizeof(int16_t);
+  }
+
+private:
+  // brickTable entries for bricks that aren't stored
+  static constexpr int32_t ALL_OUTSIDE = -1, ALL_INSIDE = -2;
+
+  // quantizes one brick's samples into out, false if they're all clamped to
+  // the same end (then inside says which)
+  bool bakeBrick(const TriangleBVH &mesh, float ceiling, int bx, int by,
+                 int bz, int16_t *out, bool &inside) const;
+
+  Settings settings;
+  int bricksX = 0, bricksY = 0, bricksZ = 0;
+  glm::vec3 invCellSize = glm::vec3(1, 1, 1);
+  glm::vec3 maxCell = glm::vec3(0, 0, 0); // last valid cell coordinate
+  float toDistance = 1;                   // sample value to world units
+
+  vector<int32_t> brickTable; // x fastest, then y, then z
+  vector<int16_t> samples;    // stored bricks, BRICK_SAMPLES each, x fastest
+};
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// Names one entity in an EntityPool for as long as it lives. Stays valid
+// while the entity moves around inside the pool and stops resolving once it
+// was removed, even if its slot got reused since.
+struct EntityHandle {
+  static constexpr uint32_t NONE = ~0u;
+  uint32_t slot = NONE;
+  uint32_t generation = 0;
+
+  bool operator==(const EntityHandle &other) const {
+    return slot == other.slot && generation == other.generation;
+  }
+  bool operator!=(const EntityHandle &other) const { return !(*this == other); }
+};
+
+// Dense, unordered storage with O(1) births and deaths. Items live packed in
+// one vector (so the per tick loops and kernels can walk them by index);
+// handles go through a slot table that follows them around. Removing
+// swap-and-pops the last item into the hole, so indices only change at the
+// points removals are applied (compact()), never while a tick is running.
+//
+// Nothing is given back: the items' capacity, the slot table and the free
+// list only grow, so once a scene reaches its peak population spawning and
+// dying stop allocating.
+template <typename T> class EntityPool {
+public:
+  // a copy of item
+  EntityHandle add(const T &item) {
+    grow(1);
+    items.push_back(item);
+    return bind(items.size() - 1);
+  }
+
+  // count default constructed items, init(item) called on each. Reserves
+  // once for the whole batch.
+  template <typename Init> void spawn(int count, Init &&init) {
+    if (count <= 0) {
+      return;
+    }
+    grow(count);
+    for (int i = 0; i < count; i++) {
+      items.emplace_back();
+      init(items.back());
+      bind(items.size() - 1);
+    }
+  }
+
+  // deferred until the next compact(), so indices stay put until then
+  void remove(EntityHandle handle) { removals.push_back(handle); }
+
+  // applies the remove()s and drops every item dead(item) is true for
+  template <typename Dead> void compact(Dead &&dead) {
+    compact(dead, [](size_t) {});
+  }
+  // same, and removed(index) after every swap-and-pop, so arrays kept in the
+  // same order as the items (see Flock) can move their last entry into index
+  // too
+  template <typename Dead, typename Removed>
+  void compact(Dead &&dead, Removed &&removed) {
+    for (EntityHandle handle : removals) {
+      if (valid(handle)) {
+        size_t index = indexOf[handle.slot];
+        removeAt(index);
+        removed(index);
+      }
+    }
+    removals.clear();
+    for (size_t i = 0; i < items.size();) {
+      if (dead(items[i])) {
+        removeAt(i); // the last one moved into i, look at it again
+        removed(i);
+      } else {
+        i++;
+      }
+    }
+  }
+
+  void clear() {
+    while (!items.empty()) {
+      removeAt(items.size() - 1);
+    }
+    removals.clear();
+  }
+
+  bool valid(EntityHandle handle) const {
+    return handle.slot < generations.size() &&
+           generations[handle.slot] == handle.generation &&
+           indexOf[handle.slot] != EntityHandle::NONE;
+  }
+  // nullptr once it's gone
+  T *get(EntityHandle handle) {
+    return valid(handle) ? &items[indexOf[handle.slot]] : nullptr;
+  }
+  const T *get(EntityHandle handle) const {
+    return valid(handle) ? &items[indexOf[handle.slot]] : nullptr;
+  }
+  EntityHandle handleAt(size_t index) const {
+    uint32_t slot = slotOf[index];
+    return {slot, generations[slot]};
+  }
+
+  // the packed items, in no particular order
+  const std::vector<T> &data() const { return items; }
+  size_t size() const { return items.size(); }
+  bool empty() const { return items.empty(); }
+  size_t capacity() const { return items.capacity(); }
+  T &operator[](size_t index) { return items[index]; }
+  const T &operator[](size_t index) const { return items[index]; }
+  typename std::vector<T>::iterator begin() { return items.begin(); }
+  typename std::vector<T>::iterator end() { return items.end(); }
+  typename std::vector<T>::const_iterator begin() const {
+    return items.begin();
+  }
+  typename std::vector<T>::const_iterator end() const { return items.end(); }
+
+private:
+  // room for count more without reallocating per item, doubling so bursts
+  // of a few don't reallocate every time
+  void grow(size_t count) {
+    size_t needed = items.size() + count;
+    if (needed > items.capacity()) {
+      size_t capacity = std::max(needed, items.capacity() * 2);
+      items.reserve(capacity);
+      slotOf.reserve(capacity);
+    }
+  }
+
+  // gives the item at index (the last one) a slot
+  EntityHandle bind(size_t index) {
+    uint32_t slot;
+    if (!freeSlots.empty()) {
+      slot = freeSlots.back();
+      freeSlots.pop_back();
+    } else {
+      slot = generations.size();
+      generations.push_back(0);
+      indexOf.push_back(EntityHandle::NONE);
+    }
+    indexOf[slot] = index;
+    slotOf.push_back(slot);
+    return {slot, generations[slot]};
+  }
+
+  void removeAt(size_t index) {
+    uint32_t slot = slotOf[index];
+    size_t last = items.size() - 1;
+    if (index != last) {
+      items[index] = std::move(items[last]);
+      slotOf[index] = slotOf[last];
+      indexOf[slotOf[index]] = index;
+    }
+    items.pop_back();
+    slotOf.pop_back();
+    indexOf[slot] = EntityHandle::NONE;
+    generations[slot]++; // old handles to it stop resolving
+    freeSlots.push_back(slot);
+  }
+
+  std::vector<T> items;
+  std::vector<uint32_t> slotOf;      // items[i]'s slot
+  std::vector<uint32_t> indexOf;     // slot -> index into items, NONE if free
+  std::vector<uint32_t> generations; // bumped every time a slot is freed
+  std::vector<uint32_t> freeSlots;
+  std::vector<EntityHandle> removals; // queued by remove()
+};
@@ -1,72 +1,215 @@
 #include "Flock.hpp"
 #include "Boid.hpp"
-
-Flock::Flock() {
-  if (type == "prey") {
-    model.load("fish.obj");
-  } else if (type == "predator") {
-    model.load("fish.obj");
-    model.setScale(2, 2, 2);
-  }
-  // model.loadModel("fish.obj");
-  // model.setScale(0.8, 0.8, 0.8);
-  model.disableMaterials();
-  model.disableTextures();
-  // model.setScaleNormalization(false);
-}
+#include "SteeringKernels.hpp"
+#include "ThreadPool.hpp"
+#include <atomic>
 
 void Flock::generateFlock(int numBoids) {
-  for (int i = 0; i < numBoids; i++) {
-    Boid boid;
-    if (type == "predator") {
-      boid.type = "predator";
+  boids.spawn(numBoids, [&](Boid &boid) {
+    Rng boidRng = rng.split(spawned++);
+    // one draw per statement, argument evaluation order isn't fixed and the
+    // same seed has to give the same boid with any compiler
+    auto draw3 = [&](glm::vec3 lo, glm::vec3 hi) {
+      float x = boidRng.uniform(lo.x, hi.x);
+      float y = boidRng.uniform(lo.y, hi.y);
+      float z = boidRng.uniform(lo.z, hi.z);
+      return glm::vec3(x, y, z);
+    };
+    glm::vec3 velocity =
+        draw3(glm::vec3(-0.1, 0, -0.1), glm::vec3(0.1, 0, 0.1));
+    glm::vec3 acceleration = draw3(glm::vec3(-0.1), glm::vec3(0.1));
+    glm::vec3 position =
+        draw3(glm::vec3(-300, -50, -300), glm::vec3(300, 0, 300));
+    hot.push_back(position, velocity, acceleration);
+    boid.randomize(boidRng);
+    boid.kind = kind;
+    // speed, force and vision come from the flock (see getParams)
+    if (kind == BoidKind::PREDATOR) {
       boid.fishColor = ofColor::red;
-      boid.maxSpeed = 0.2;
-      boid.maxForce = 0.003;
-      boid.visionRadius = 50.0;
-      // pass in different flocking params
-      // change vision radius
     }
-    if (type == "food") {
-      boid.type = "food";
+    if (kind == BoidKind::FOOD) {
       boid.fishColor = ofColor::green;
-      boid.maxSpeed = 0;
-      boid.maxForce = 0;
-      boid.visionRadius = 0;
     }
+  });
+}
+
+EntityHandle Flock::add(const Boid &boid, const glm::vec3 &position,
+                        const glm::vec3 &velocity) {
+  hot.push_back(position, velocity, glm::vec3(0, 0, 0));
+  return boids.add(boid);
+}
+
+void Flock::remove(EntityHandle handle) { boids.remove(handle); }
 
-    boids.push_back(boid);
+void Flock::setParams(const Boid::BoidParams &sliders) {
+  Boid::KindParams next = getParams();
+  dispatchKind(kind, [&](auto tag) { next.set<decltype(tag)::value>(sliders); });
+  if (paramsVersion == 0 || !(next == params)) {
+    params = next;
+    paramsVersion++;
   }
 }
 
-void Flock::add(const Boid &b) { boids.push_back(b); }
+const Boid::KindParams &Flock::getParams() const {
+  return paramsVersion > 0 ? params : Boid::KindParams::defaults(kind);
+}
+
+void Flock::compact() {
+  boids.compact([](const Boid &boid) { return boid.health <= 0; },
+                [&](size_t i) { hot.removeAt(i); });
+}
 
-void Flock::remove(int i) { boids.erase(boids.begin() + i); }
+void Flock::step(const InteractionIndex &others,
+                 const DistanceField &terrain) {
+  int n = boids.size();
+  const Boid::KindParams &p = getParams();
+  grid.build(hot, std::max({p.separationRadius, p.alignmentRadius,
+                            p.cohesionRadius}));
 
-void Flock::update(const Boid::BoidParams &params, const Boid::Features &features) {
-  for (auto &boid : boids) {
-    boid.updateParams(params, features);
+  ThreadPool &pool = ThreadPool::shared();
+
+  // steering phase: reads the snapshot in grid, each boid only writes itself,
+  // so the result doesn't depend on how the chunks get scheduled
+  std::atomic<unsigned long> checks{0};
+  dispatchKind(kind, [&](auto tag) {
+    constexpr BoidKind K = decltype(tag)::value;
+    pool.parallelFor(n, 128, [&](int begin, int end) {
+      unsigned long chunkChecks = 0;
+      for (int i = begin; i < end; i++) {
+        Boid &boid = boids[i];
+        glm::vec3 position = hot.position(i);
+        glm::vec3 velocity = hot.velocity(i);
+        glm::vec3 acceleration = glm::vec3(hot.ax[i], hot.ay[i], hot.az[i]);
+        // the nearest bit of terrain is straight down the gradient
+        glm::vec3 away;
+        float distance = terrain.sample(position, away);
+        boid.collisionPoint = position - away * distance;
+        boid.hasCollisionPoint =
+            distance < Boid::collisionRadius && away != glm::vec3(0, 0, 0);
+        boid.underHeight = distance < 0;
+        boid.applyBehaviors<K>(p, grid, i, others, position, velocity,
+                               acceleration);
+        boid.checkInteraction<K>(p, others, position);
+        hot.ax[i] = acceleration.x;
+        hot.ay[i] = acceleration.y;
+        hot.az[i] = acceleration.z;
+        chunkChecks += boid.neighborChecks;
+      }
+      checks += chunkChecks;
+    });
+  });
+  neighborChecks = checks;
+
+  // write phase: move everyone, keeping where they were to draw in between
+  // ticks
+  pool.parallelFor(n, 2048, [&](int begin, int end) {
+    std::copy(hot.px.begin() + begin, hot.px.begin() + end,
+              hot.ox.begin() + begin);
+    std::copy(hot.py.begin() + begin, hot.py.begin() + end,
+              hot.oy.begin() + begin);
+    std::copy(hot.pz.begin() + begin, hot.pz.begin() + end,
+              hot.oz.begin() + begin);
+    integrateBoids(hot, begin, end, p.maxSpeed, grid.boundsMin,
+                   grid.boundsMax);
+  });
+}
+
+void Flock::snapshot(FlockSnapshot &snapshot) const {
+  snapshot.hot = hot;
+  snapshot.boids = boids.data();
+}
+
+glm::vec3 FlockSnapshot::interpolatedPosition(size_t i, float alpha) const {
+  glm::vec3 position = hot.position(i);
+  glm::vec3 previous = hot.previousPosition(i);
+  // don't smear across the box when the boid wrapped around
+  if (glm::length(position - previous) > 100) {
+    return position;
+  }
+  return glm::mix(previous, position, alpha);
+}
+
+// rotation that turns the fish's nose (-z) towards velocity, about the axis
+// perpendicular to both
+static void facing(const glm::vec3 &velocity, glm::mat4 &transform) {
+  float length = glm::length(velocity);
+  glm::vec3 dir = length > 0 ? velocity / length : glm::vec3(0, 0, -1);
+  // half way quaternion between nose and dir: w = 1 + dot(nose, dir),
+  // xyz = cross(nose, dir)
+  float w = 1 - dir.z, x = dir.y, y = -dir.x;
+  if (w < 1e-6f) {
+    // swimming straight backwards, half a turn about y
+    transform[0] = glm::vec4(-1, 0, 0, 0);
+    transform[1] = glm::vec4(0, 1, 0, 0);
+    transform[2] = glm::vec4(0, 0, -1, 0);
+    return;
   }
+  // the usual quaternion to matrix terms divided by |q|^2 / 2 = w, z is
+  // always 0 and the w * x / w, w * y / w terms are just x and y
+  float s = 1 / w;
+  float xx = x * x * s, yy = y * y * s, xy = x * y * s;
+  transform[0] = glm::vec4(1 - yy, xy, -y, 0);
+  transform[1] = glm::vec4(xy, 1 - xx, x, 0);
+  transform[2] = glm::vec4(y, -x, 1 - xx - yy, 0);
 }
 
-void Flock::draw(vector<Boid> &predators, const vector<Boid> &prey,
-                 std::vector<std::vector<float>> &heightMap) {
-  // Remove dead boids
+static void pack(const Boid &boid, const glm::vec3 &position,
+                 const glm::vec3 &velocity, float size, bool turns,
+                 InstancedMesh::Instance &instance) {
+  glm::mat4 &transform = instance.transform;
+  if (turns) {
+    facing(velocity, transform);
+  } else {
+    transform = glm::mat4(1.0f);
+  }
+  transform[0] *= size;
+  transform[1] *= size;
+  transform[2] *= size;
+  transform[3] = glm::vec4(position, 1);
+  instance.color = boid.fishColor;
+}
 
-  if (boids.size()) {
-    boids.erase(
-        std::remove_if(boids.begin(), boids.end(),
-                       [](const Boid &boid) { return boid.health <= 0; }),
-        boids.end());
+void Flock::packInstances(const FlockSnapshot &snapshot, float alpha,
+                          vector<InstancedMesh::Instance> &instances) const {
+  float size = traitsOf(kind).drawSize;
+  bool turns = traitsOf(kind).turns;
+  instances.resize(snapshot.boids.size());
+  for (size_t i = 0; i < snapshot.boids.size(); i++) {
+    pack(snapshot.boids[i], snapshot.interpolatedPosition(i, alpha),
+         snapshot.hot.velocity(i), size, turns, instances[i]);
   }
+}
 
-  // Set Predator and Prey vectors
+void Flock::packInstances(const FlockSnapshot &snapshot, float alpha,
+                          const ViewCuller &culler,
+                          vector<InstancedMesh::Instance> &near,
+                          vector<InstancedMesh::Instance> &far) const {
+  float size = traitsOf(kind).drawSize;
+  bool turns = traitsOf(kind).turns;
+  near.clear();
+  far.clear();
+  for (size_t i = 0; i < snapshot.boids.size(); i++) {
+    glm::vec3 position = snapshot.interpolatedPosition(i, alpha);
+    switch (culler.classify(position, size)) {
+    case ViewCuller::NEAR:
+      pack(snapshot.boids[i], position, snapshot.hot.velocity(i), size, turns,
+           near.emplace_back());
+      break;
+    case ViewCuller::FAR:
+      pack(snapshot.boids[i], position, snapshot.hot.velocity(i), size, turns,
+           far.emplace_back());
+      break;
+    default:
+      break;
+    }
+  }
+}
 
-  for (auto &boid : boids) {
-    boid.applyBehaviors(boids, predators, prey,
-                        heightMap); // TODO move this into update lmfao
-    boid.checkInteraction(predators);
-    boid.update();
-    boid.draw(model);
+void Flock::drawOverlays(const FlockSnapshot &snapshot, float alpha,
+                         const Boid::Features &features) const {
+  for (size_t i = 0; i < snapshot.boids.size(); i++) {
+    snapshot.boids[i].drawOverlays(features,
+                                   snapshot.interpolatedPosition(i, alpha),
+                                   snapshot.hot.velocity(i));
   }
 }
\ No newline at end of file
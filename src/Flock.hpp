@@ -1,25 +1,82 @@
 #pragma once
 
 #include "Boid.hpp"
+#include "BoidSoA.hpp"
+#include "DistanceField.hpp"
+#include "EntityPool.hpp"
+#include "InstancedMesh.hpp"
+#include "InteractionIndex.hpp"
+#include "SpatialGrid.hpp"
+#include "ViewCuller.hpp"
 #include "ofMain.h"
-#include "ofxAssimpModel.h"
 
+// A Flock's state as of one tick, copied out for the render thread (see
+// Simulation::Snapshot): the hot arrays and the boids, in the same order.
+struct FlockSnapshot {
+  BoidSoA hot;
+  vector<Boid> boids;
+
+  // alpha blends boid i from its previous position to its position
+  glm::vec3 interpolatedPosition(size_t i, float alpha) const;
+};
+
+// Simulation side of a group of boids of one kind. Rendering resources live
+// in ofApp so a Flock can be stepped without a GL context.
 class Flock {
 public:
-  Flock();
-  void draw(vector<Boid> &predators, const vector<Boid>& prey, std::vector<std::vector<float>>& heightMap);
-  void add(const Boid &); // so that we can insert a pet :sob:
-  void remove(int i);     // based on indexing, what if it's just the amount?
+  // one simulation tick: steer and move everyone. others has every kind's
+  // boids as they were at the start of the tick (see Simulation::step),
+  // terrain is what they steer clear of
+  void step(const InteractionIndex &others, const DistanceField &terrain);
+  // copies the state out after a step, reusing snapshot's storage
+  void snapshot(FlockSnapshot &snapshot) const;
+  // one instance per boid of a copy taken after a step (see Simulation),
+  // alpha blends between the last two positions. CPU only, ofApp uploads and
+  // draws them.
+  void packInstances(const FlockSnapshot &snapshot, float alpha,
+                     vector<InstancedMesh::Instance> &instances) const;
+  // same but only what the culler lets through, split into the ones to draw
+  // with the full mesh and the ones past the LOD distance
+  void packInstances(const FlockSnapshot &snapshot, float alpha,
+                     const ViewCuller &culler,
+                     vector<InstancedMesh::Instance> &near,
+                     vector<InstancedMesh::Instance> &far) const;
+  // the debug overlays of the same copy (see Boid::drawOverlays)
+  void drawOverlays(const FlockSnapshot &snapshot, float alpha,
+                    const Boid::Features &features) const;
+  // so that we can insert a pet :sob:
+  EntityHandle add(const Boid &boid, const glm::vec3 &position,
+                   const glm::vec3 &velocity);
+  // gone at the next compact(), the handle stops resolving then
+  void remove(EntityHandle handle);
+  // end of tick: applies remove()s and drops the boids that died, the
+  // survivors get swapped into the holes
+  void compact();
   // for now we want infinite lifespan particles
   void reset();  // used to set all forces to zero? or unapplied
-  void update(const Boid::BoidParams &params, const Boid::Features& features); // remove those past lifespan and
-                                               // udpate particle forces
-  
+  // the sliders this flock's kind cares about into its KindParams, O(1)
+  // however many boids there are. The version only moves if a value did.
+  void setParams(const Boid::BoidParams &params);
+  // what every boid in it steers by, the kind's defaults until setParams
+  const Boid::KindParams &getParams() const;
+  uint64_t getParamsVersion() const { return paramsVersion; }
+
   void applyForces();
+  // numBoids more, boid number i (counting every one this flock ever
+  // spawned) draws from rng.split(i), so the same seed spawns the same boids
+  // however the spawns are batched
   void generateFlock(int numBoids);
 
-  vector<Boid> boids;
+  EntityPool<Boid> boids;
+  BoidSoA hot;      // position/velocity/acceleration of boids[i] at index i
+  SpatialGrid grid; // rebuilt over boids every step
+  unsigned long neighborChecks = 0; // candidates looked at in the last step
+
+  BoidKind kind = BoidKind::PREY; // of every boid in it
+  Rng rng;                        // set by Simulation::setSeed
+  uint64_t spawned = 0;           // boids generateFlock made so far
 
-  ofx::assimp::Model model;
-  std::string type = "prey";
+private:
+  Boid::KindParams params;
+  uint64_t paramsVersion = 0; // 0 = never set, params isn't used
 };
\ No newline at end of file
@@ -0,0 +1,29 @@
+#include "HeightField.hpp"
+
+void HeightField::setup(int cols, int rows, glm::vec2 origin, float spacing) {
+  this->cols = cols;
+  this->rows = rows;
+  this->origin = origin;
+  this->spacing = spacing;
+  invSpacing = 1.0f / spacing;
+  heights.assign(cols * rows, 0.0f);
+}
+
+float HeightField::surface(float x, float z) const {
+  if (cols < 2 || rows < 2) {
+    return heights.empty() ? 0 : heights[0]; // no triangles, one sample
+  }
+  float fx = std::clamp((x - origin.x) * invSpacing, 0.0f, (float)(cols - 1));
+  float fz = std::clamp((z - origin.y) * invSpacing, 0.0f, (float)(rows - 1));
+  int col = std::min((int)fx, cols - 2);
+  int row = std::min((int)fz, rows - 2);
+  float tx = fx - col;
+  float tz = fz - row;
+  const float *h = &heights[row * cols + col];
+  // split from (col + 1, row) to (col, row + 1), like the mesh
+  if (tx + tz <= 1) {
+    return h[0] + (h[1] - h[0]) * tx + (h[cols] - h[0]) * tz;
+  }
+  return h[cols + 1] + (h[cols] - h[cols + 1]) * (1 - tx) +
+         (h[1] - h[cols + 1]) * (1 - tz);
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "ofMain.h"
+
+// Terrain heights on a regular grid in world space, stored row-major in one
+// buffer. Row r / column c sits at origin + (c, r) * spacing on the xz plane.
+class HeightField {
+public:
+  void setup(int cols, int rows, glm::vec2 origin, float spacing);
+
+  float &at(int col, int row) { return heights[row * cols + col]; }
+  float at(int col, int row) const { return heights[row * cols + col]; }
+
+  // height of the triangles TriangleMesh::fromHeightField makes, i.e. what
+  // the boids collide with, clamped to the edges
+  float surface(float x, float z) const;
+
+  bool empty() const { return heights.empty(); }
+  int getCols() const { return cols; }
+  int getRows() const { return rows; }
+  glm::vec2 getOrigin() const { return origin; }
+  float getSpacing() const { return spacing; }
+  const vector<float> &getHeights() const { return heights; }
+
+private:
+  vector<float> heights;
+  int cols = 0, rows = 0;
+  glm::vec2 origin = glm::vec2(0, 0);
+  float spacing = 1;
+  float invSpacing = 1;
+};
@@ -0,0 +1,57 @@
+#include "InstancedMesh.hpp"
+
+void InstancedMesh::setup(const ofMesh &mesh) {
+  vbo.setMesh(mesh, GL_STATIC_DRAW);
+  numIndices = mesh.getNumIndices();
+  primitive = ofGetGLPrimitiveMode(mesh.getMode());
+
+  // the buffer keeps its id when it grows later on, so the attributes only
+  // need to point at it once
+  instanceBuffer.allocate(sizeof(Instance), GL_STREAM_DRAW);
+  for (int column = 0; column < 4; column++) {
+    vbo.setAttributeBuffer(TRANSFORM_LOCATION + column, instanceBuffer, 4,
+                           sizeof(Instance),
+                           offsetof(Instance, transform) +
+                               column * sizeof(glm::vec4));
+    vbo.setAttributeDivisor(TRANSFORM_LOCATION + column, 1);
+  }
+  vbo.setAttributeBuffer(COLOR_LOCATION, instanceBuffer, 4, sizeof(Instance),
+                         offsetof(Instance, color));
+  vbo.setAttributeDivisor(COLOR_LOCATION, 1);
+}
+
+ofMesh InstancedMesh::impostor(const ofMesh &mesh) {
+  glm::vec3 lo(std::numeric_limits<float>::max());
+  glm::vec3 hi(-std::numeric_limits<float>::max());
+  for (auto &v : mesh.getVertices()) {
+    lo = glm::min(lo, v);
+    hi = glm::max(hi, v);
+  }
+  glm::vec3 mid = (lo + hi) * 0.5f;
+
+  ofMesh quads;
+  quads.setMode(OF_PRIMITIVE_TRIANGLES);
+  // flat one through the middle, then the upright one
+  quads.addVertex(glm::vec3(lo.x, mid.y, lo.z));
+  quads.addVertex(glm::vec3(hi.x, mid.y, lo.z));
+  quads.addVertex(glm::vec3(hi.x, mid.y, hi.z));
+  quads.addVertex(glm::vec3(lo.x, mid.y, hi.z));
+  quads.addVertex(glm::vec3(mid.x, lo.y, lo.z));
+  quads.addVertex(glm::vec3(mid.x, hi.y, lo.z));
+  quads.addVertex(glm::vec3(mid.x, hi.y, hi.z));
+  quads.addVertex(glm::vec3(mid.x, lo.y, hi.z));
+  for (ofIndexType quad = 0; quad < 8; quad += 4) {
+    quads.addIndices({quad, quad + 1, quad + 2, quad, quad + 2, quad + 3});
+  }
+  return quads;
+}
+
+void InstancedMesh::draw(const vector<Instance> &instances) {
+  if (instances.empty() || numIndices == 0) {
+    return;
+  }
+  // a fresh store every frame, the driver doesn't have to wait for the
+  // previous frame's draws to finish reading the old one
+  instanceBuffer.setData(instances, GL_STREAM_DRAW);
+  vbo.drawElementsInstanced(primitive, numIndices, instances.size());
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "ofMain.h"
+
+// Draws one mesh many times with a single draw call. Each instance brings its
+// own transform and color, read by shadersGL3/instanced.vert as per instance
+// attributes, so the cost of a flock is one buffer upload instead of a
+// push/mult/draw/pop per fish.
+class InstancedMesh {
+public:
+  // laid out the way the shader reads it, 80 bytes
+  struct Instance {
+    glm::mat4 transform; // mesh space to world
+    ofFloatColor color;
+  };
+
+  static constexpr int TRANSFORM_LOCATION = 4; // a mat4 takes 4 to 7
+  static constexpr int COLOR_LOCATION = 8;
+
+  void setup(const ofMesh &mesh);
+  // stand in for mesh far away: two quads crossed along its z axis (the way
+  // the fish face), spanning its bounding box, 4 triangles
+  static ofMesh impostor(const ofMesh &mesh);
+  // uploads the instances and draws them, with whatever shader is bound
+  void draw(const vector<Instance> &instances);
+
+private:
+  ofVbo vbo;
+  ofBufferObject instanceBuffer;
+  int numIndices = 0;
+  GLenum primitive = GL_TRIANGLES;
+};
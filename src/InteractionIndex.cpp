@@ -0,0 +1,163 @@
+#include "InteractionIndex.hpp"
+#include <limits>
+
+void InteractionIndex::build(BoidKind kind, const BoidSoA &boids,
+                             float cellSize) {
+  Layer &layer = layers[(int)kind];
+
+  // cubic cells, grown if the box would need too many of them
+  glm::vec3 extent = boundsMax - boundsMin;
+  float longest = std::max({extent.x, extent.y, extent.z});
+  layer.cellSize =
+      std::max({cellSize, 1.0f, longest / MAX_CELLS_PER_AXIS});
+  layer.invCellSize = 1.0f / layer.cellSize;
+  layer.boundsMin = boundsMin;
+  for (int axis = 0; axis < 3; axis++) {
+    layer.dims[axis] = std::clamp((int)ceilf(extent[axis] * layer.invCellSize),
+                                  1, MAX_CELLS_PER_AXIS);
+  }
+
+  // counting sort of the boids by cell
+  int n = boids.size();
+  int numCells = layer.dims[0] * layer.dims[1] * layer.dims[2];
+  layer.cellStart.assign(numCells + 1, 0);
+  layer.cell.resize(n);
+  for (int i = 0; i < n; i++) {
+    int cell = (layer.cellCoord(boids.pz[i], 2) * layer.dims[1] +
+                layer.cellCoord(boids.py[i], 1)) *
+                   layer.dims[0] +
+               layer.cellCoord(boids.px[i], 0);
+    layer.cell[i] = cell;
+    layer.cellStart[cell + 1]++;
+  }
+  for (int c = 0; c < numCells; c++) {
+    layer.cellStart[c + 1] += layer.cellStart[c];
+  }
+  for (auto *v : {&layer.px, &layer.py, &layer.pz}) {
+    v->resize(n);
+  }
+  layer.index.resize(n);
+  // cellStart[c] is the write cursor for cell c, then shifted back
+  for (int i = 0; i < n; i++) {
+    int slot = layer.cellStart[layer.cell[i]]++;
+    layer.px[slot] = boids.px[i];
+    layer.py[slot] = boids.py[i];
+    layer.pz[slot] = boids.pz[i];
+    layer.index[slot] = i;
+  }
+  for (int c = numCells; c > 0; c--) {
+    layer.cellStart[c] = layer.cellStart[c - 1];
+  }
+  layer.cellStart[0] = 0;
+}
+
+bool InteractionIndex::anyInRadius(BoidKind kind, const glm::vec3 &center,
+                                   float radius) const {
+  const Layer &layer = layers[(int)kind];
+  if (layer.index.empty()) {
+    return false;
+  }
+  int lo[3], hi[3];
+  for (int axis = 0; axis < 3; axis++) {
+    lo[axis] = layer.cellCoord(center[axis] - radius, axis);
+    hi[axis] = layer.cellCoord(center[axis] + radius, axis);
+  }
+  float radius2 = radius * radius;
+  for (int z = lo[2]; z <= hi[2]; z++) {
+    for (int y = lo[1]; y <= hi[1]; y++) {
+      int row = (z * layer.dims[1] + y) * layer.dims[0];
+      for (int slot = layer.cellStart[row + lo[0]],
+               end = layer.cellStart[row + hi[0] + 1];
+           slot < end; slot++) {
+        float dx = layer.px[slot] - center.x;
+        float dy = layer.py[slot] - center.y;
+        float dz = layer.pz[slot] - center.z;
+        if (dx * dx + dy * dy + dz * dz < radius2) {
+          return true;
+        }
+      }
+    }
+  }
+  return false;
+}
+
+int InteractionIndex::nearest(BoidKind kind, const glm::vec3 &center, int k,
+                              float maxRadius, Neighbor *out) const {
+  const Layer &layer = layers[(int)kind];
+  if (k <= 0 || layer.index.empty()) {
+    return 0;
+  }
+  int c[3];
+  for (int axis = 0; axis < 3; axis++) {
+    c[axis] = layer.cellCoord(center[axis], axis);
+  }
+  float maxRadius2 = maxRadius * maxRadius;
+  int found = 0;
+
+  // keeps out sorted by distance, at most k long
+  auto consider = [&](int slot) {
+    float dx = layer.px[slot] - center.x;
+    float dy = layer.py[slot] - center.y;
+    float dz = layer.pz[slot] - center.z;
+    float d2 = dx * dx + dy * dy + dz * dz;
+    if (d2 >= maxRadius2 || (found == k && d2 >= out[k - 1].distance2)) {
+      return;
+    }
+    int i = found < k ? found++ : k - 1;
+    for (; i > 0 && out[i - 1].distance2 > d2; i--) {
+      out[i] = out[i - 1];
+    }
+    out[i] = {glm::vec3(layer.px[slot], layer.py[slot], layer.pz[slot]), d2,
+              layer.index[slot]};
+  };
+
+  for (int ring = 0;; ring++) {
+    int lo[3], hi[3];
+    for (int axis = 0; axis < 3; axis++) {
+      lo[axis] = std::max(c[axis] - ring, 0);
+      hi[axis] = std::min(c[axis] + ring, layer.dims[axis] - 1);
+    }
+    // only the shell of cells exactly ring steps away, the inside was
+    // searched by the earlier rings
+    for (int z = lo[2]; z <= hi[2]; z++) {
+      bool zShell = std::abs(z - c[2]) == ring;
+      for (int y = lo[1]; y <= hi[1]; y++) {
+        bool yShell = zShell || std::abs(y - c[1]) == ring;
+        int row = (z * layer.dims[1] + y) * layer.dims[0];
+        for (int x = lo[0]; x <= hi[0]; x++) {
+          if (!yShell && std::abs(x - c[0]) != ring) {
+            // jump straight to the far side of the shell
+            if (x < c[0] + ring) {
+              x = std::max(x, c[0] + ring - 1);
+            }
+            continue;
+          }
+          for (int slot = layer.cellStart[row + x],
+                   end = layer.cellStart[row + x + 1];
+               slot < end; slot++) {
+            consider(slot);
+          }
+        }
+      }
+    }
+
+    // nothing outside the searched block is closer than its nearest face
+    // (faces on the edge of the grid have nothing beyond them)
+    float bound = std::numeric_limits<float>::max();
+    for (int axis = 0; axis < 3; axis++) {
+      if (lo[axis] > 0) {
+        bound = std::min(bound, center[axis] - (layer.boundsMin[axis] +
+                                                lo[axis] * layer.cellSize));
+      }
+      if (hi[axis] < layer.dims[axis] - 1) {
+        bound = std::min(bound, layer.boundsMin[axis] +
+                                    (hi[axis] + 1) * layer.cellSize -
+                                    center[axis]);
+      }
+    }
+    if (bound == std::numeric_limits<float>::max() || bound >= maxRadius ||
+        (found == k && bound * bound >= out[k - 1].distance2)) {
+      return found;
+    }
+  }
+}
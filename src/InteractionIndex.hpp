@@ -0,0 +1,96 @@
+#pragma once
+
+#include "BoidKind.hpp"
+#include "BoidSoA.hpp"
+#include "ofMain.h"
+
+// Where every living boid of every kind is, for the queries that cross
+// kinds: prey looking for predators and food, predators looking for prey,
+// and who gets eaten. One layer per BoidKind, each a uniform grid with its
+// positions copied out in cell order. All layers are built once per tick
+// (see Simulation::step) and only read after that, so any number of threads
+// can query them while the flocks step.
+//
+// Distances are plain euclidean, the queries don't wrap around the box edges
+// (neither do SpatialGrid's).
+class InteractionIndex {
+public:
+  // same box as SpatialGrid, positions outside it go in the edge cells
+  glm::vec3 boundsMin = glm::vec3(-375, -100, -375);
+  glm::vec3 boundsMax = glm::vec3(375, 0, 375);
+
+  static constexpr int MAX_CELLS_PER_AXIS = 64;
+
+  struct Neighbor {
+    glm::vec3 position;
+    float distance2;
+    int index; // into the arrays the layer was built from
+  };
+
+  // puts a flock's boids into kind's layer (they're all alive, see
+  // Flock::compact), cellSize should be about the largest radius anyone
+  // queries it with
+  void build(BoidKind kind, const BoidSoA &boids, float cellSize);
+
+  // fn(position, distance2, index) for every boid of kind within radius
+  template <typename Fn>
+  void forEachInRadius(BoidKind kind, const glm::vec3 &center, float radius,
+                       Fn &&fn) const {
+    const Layer &layer = layers[(int)kind];
+    if (layer.index.empty()) {
+      return;
+    }
+    int lo[3], hi[3];
+    for (int axis = 0; axis < 3; axis++) {
+      lo[axis] = layer.cellCoord(center[axis] - radius, axis);
+      hi[axis] = layer.cellCoord(center[axis] + radius, axis);
+    }
+    float radius2 = radius * radius;
+    for (int z = lo[2]; z <= hi[2]; z++) {
+      for (int y = lo[1]; y <= hi[1]; y++) {
+        int row = (z * layer.dims[1] + y) * layer.dims[0];
+        for (int slot = layer.cellStart[row + lo[0]],
+                 end = layer.cellStart[row + hi[0] + 1];
+             slot < end; slot++) {
+          float dx = layer.px[slot] - center.x;
+          float dy = layer.py[slot] - center.y;
+          float dz = layer.pz[slot] - center.z;
+          float d2 = dx * dx + dy * dy + dz * dz;
+          if (d2 < radius2) {
+            fn(glm::vec3(layer.px[slot], layer.py[slot], layer.pz[slot]), d2,
+               layer.index[slot]);
+          }
+        }
+      }
+    }
+  }
+
+  // is there any boid of kind within radius
+  bool anyInRadius(BoidKind kind, const glm::vec3 &center, float radius) const;
+
+  // the (up to) k boids of kind closest to center within maxRadius, nearest
+  // first. Searches outwards ring by ring and stops as soon as nothing
+  // unsearched can be closer than the k-th found.
+  int nearest(BoidKind kind, const glm::vec3 &center, int k, float maxRadius,
+              Neighbor *out) const;
+
+  int size(BoidKind kind) const { return layers[(int)kind].index.size(); }
+
+private:
+  struct Layer {
+    int dims[3] = {1, 1, 1};
+    glm::vec3 boundsMin = glm::vec3(0, 0, 0);
+    float cellSize = 1, invCellSize = 1;
+    vector<int> cellStart; // numCells + 1 offsets into the sorted arrays
+    vector<float> px, py, pz;
+    vector<int> index; // boid each sorted slot came from
+    vector<int> cell;  // scratch for the counting sort
+
+    int cellCoord(float v, int axis) const {
+      int c = (int)floorf((v - boundsMin[axis]) * invCellSize);
+      return std::clamp(c, 0, dims[axis] - 1);
+    }
+  };
+
+  Layer layers[NUM_BOID_KINDS];
+};
@@ -0,0 +1,445 @@
+#include "MeshCache.hpp"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <unordered_map>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+static constexpr char MAGIC[8] = {'B', 'O', 'I', 'D', 'M', 'E', 'S', 'H'};
+static constexpr size_t ALIGNMENT = 64;
+
+enum Section { VERTICES, NORMALS, TEX_COORDS, INDICES, HEIGHTS, NUM_SECTIONS };
+static constexpr size_t elementSize[NUM_SECTIONS] = {
+    sizeof(glm::vec3), sizeof(glm::vec3), sizeof(glm::vec2),
+    sizeof(ofIndexType), sizeof(float)};
+
+struct MeshCache::Entry::Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t indexSize; // sizeof(ofIndexType) of the build that wrote it
+  uint64_t key;
+  uint64_t fileSize;
+  uint64_t offset[NUM_SECTIONS]; // bytes from the start of the file
+  uint64_t count[NUM_SECTIONS];  // elements, not bytes
+  int32_t heightCols, heightRows;
+  float heightOrigin[2];
+  float heightSpacing;
+  uint32_t unused;
+};
+
+static size_t alignUp(size_t size) {
+  return (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+}
+
+// -------------------------------------------------------------------- Entry
+
+void MeshCache::Entry::close() {
+  if (!data) {
+    return;
+  }
+#ifdef _WIN32
+  delete[] data;
+#else
+  munmap((void *)data, size);
+#endif
+  data = nullptr;
+  size = 0;
+}
+
+template <class T>
+static std::span<const T> section(const char *data, uint64_t offset,
+                                  uint64_t count) {
+  return {reinterpret_cast<const T *>(data + offset), (size_t)count};
+}
+
+std::span<const glm::vec3> MeshCache::Entry::vertices() const {
+  return section<glm::vec3>(data, header().offset[VERTICES],
+                            header().count[VERTICES]);
+}
+
+std::span<const glm::vec3> MeshCache::Entry::normals() const {
+  return section<glm::vec3>(data, header().offset[NORMALS],
+                            header().count[NORMALS]);
+}
+
+std::span<const glm::vec2> MeshCache::Entry::texCoords() const {
+  return section<glm::vec2>(data, header().offset[TEX_COORDS],
+                            header().count[TEX_COORDS]);
+}
+
+std::span<const ofIndexType> MeshCache::Entry::indices() const {
+  return section<ofIndexType>(data, header().offset[INDICES],
+                              header().count[INDICES]);
+}
+
+bool MeshCache::Entry::hasHeightField() const {
+  return header().count[HEIGHTS] > 0;
+}
+
+void MeshCache::Entry::copyTo(ofMesh &mesh) const {
+  auto v = vertices();
+  auto n = normals();
+  auto t = texCoords();
+  auto i = indices();
+  mesh.getVertices().assign(v.begin(), v.end());
+  mesh.getNormals().assign(n.begin(), n.end());
+  mesh.getTexCoords().assign(t.begin(), t.end());
+  mesh.getIndices().assign(i.begin(), i.end());
+}
+
+void MeshCache::Entry::copyTo(HeightField &heightField) const {
+  const Header &h = header();
+  heightField.setup(h.heightCols, h.heightRows,
+                    glm::vec2(h.heightOrigin[0], h.heightOrigin[1]),
+                    h.heightSpacing);
+  if (h.count[HEIGHTS] > 0) {
+    memcpy(&heightField.at(0, 0), data + h.offset[HEIGHTS],
+           h.count[HEIGHTS] * sizeof(float));
+  }
+}
+
+// --------------------------------------------------------------- MeshCache
+
+void MeshCache::setDirectory(const std::string &directory) {
+  this->directory = directory;
+  if (!directory.empty()) {
+    std::error_code error;
+    fs::create_directories(directory, error);
+  }
+}
+
+std::string MeshCache::path(const std::string &name) const {
+  return (fs::path(directory) / name).string();
+}
+
+bool MeshCache::open(const std::string &name, uint64_t key,
+                     Entry &entry) const {
+  entry.close();
+  if (directory.empty()) {
+    return false;
+  }
+  std::string file = path(name);
+
+#ifdef _WIN32
+  std::ifstream in(file, std::ios::binary | std::ios::ate);
+  if (!in) {
+    return false;
+  }
+  size_t size = in.tellg();
+  char *data = new char[size];
+  in.seekg(0);
+  in.read(data, size);
+  entry.data = data;
+  entry.size = size;
+  if (!in) {
+    entry.close();
+    return false;
+  }
+#else
+  int fd = ::open(file.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size == 0) {
+    ::close(fd);
+    return false;
+  }
+  void *data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd); // the mapping keeps the file alive
+  if (data == MAP_FAILED) {
+    return false;
+  }
+  entry.data = (const char *)data;
+  entry.size = info.st_size;
+#endif
+
+  // anything that doesn't add up is a miss, the caller regenerates and
+  // overwrites it
+  if (entry.size < sizeof(Entry::Header)) {
+    entry.close();
+    return false;
+  }
+  const Entry::Header &h = entry.header();
+  bool valid = memcmp(h.magic, MAGIC, sizeof(MAGIC)) == 0 &&
+               h.version == VERSION && h.indexSize == sizeof(ofIndexType) &&
+               h.key == key && h.fileSize == entry.size &&
+               h.count[HEIGHTS] == (uint64_t)std::max(h.heightCols, 0) *
+                                       (uint64_t)std::max(h.heightRows, 0);
+  for (int s = 0; s < NUM_SECTIONS && valid; s++) {
+    valid = h.offset[s] % ALIGNMENT == 0 && h.offset[s] <= entry.size &&
+            h.count[s] <= (entry.size - h.offset[s]) / elementSize[s];
+  }
+  if (!valid) {
+    entry.close();
+    return false;
+  }
+
+  // mark it used so trim() keeps it
+  std::error_code error;
+  fs::last_write_time(file, fs::file_time_type::clock::now(), error);
+  return true;
+}
+
+bool MeshCache::save(const std::string &name, uint64_t key,
+                     const Contents &contents) const {
+  if (directory.empty()) {
+    return false;
+  }
+
+  Entry::Header h{};
+  memcpy(h.magic, MAGIC, sizeof(MAGIC));
+  h.version = VERSION;
+  h.indexSize = sizeof(ofIndexType);
+  h.key = key;
+
+  const void *source[NUM_SECTIONS] = {
+      contents.vertices.data(), contents.normals.data(),
+      contents.texCoords.data(), contents.indices.data(), nullptr};
+  h.count[VERTICES] = contents.vertices.size();
+  h.count[NORMALS] = contents.normals.size();
+  h.count[TEX_COORDS] = contents.texCoords.size();
+  h.count[INDICES] = contents.indices.size();
+  if (const HeightField *field = contents.heightField) {
+    source[HEIGHTS] = field->getHeights().data();
+    h.count[HEIGHTS] = field->getHeights().size();
+    h.heightCols = field->getCols();
+    h.heightRows = field->getRows();
+    h.heightOrigin[0] = field->getOrigin().x;
+    h.heightOrigin[1] = field->getOrigin().y;
+    h.heightSpacing = field->getSpacing();
+  }
+
+  size_t offset = alignUp(sizeof(h));
+  for (int s = 0; s < NUM_SECTIONS; s++) {
+    h.offset[s] = offset;
+    offset = alignUp(offset + h.count[s] * elementSize[s]);
+  }
+  h.fileSize = offset;
+
+  std::string file = path(name);
+  std::string temporary = file + ".tmp";
+  {
+    std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+    if (!out) {
+      return false;
+    }
+    static const char padding[ALIGNMENT] = {};
+    size_t written = 0;
+    auto write = [&](const void *bytes, size_t size) {
+      out.write((const char *)bytes, size);
+      written += size;
+    };
+    write(&h, sizeof(h));
+    for (int s = 0; s < NUM_SECTIONS; s++) {
+      write(padding, h.offset[s] - written);
+      write(source[s], h.count[s] * elementSize[s]);
+    }
+    write(padding, h.fileSize - written);
+    if (!out) {
+      out.close();
+      fs::remove(temporary);
+      return false;
+    }
+  }
+  std::error_code error;
+  fs::rename(temporary, file, error);
+  if (error) {
+    fs::remove(temporary, error);
+    return false;
+  }
+  return true;
+}
+
+void MeshCache::trim(size_t maxBytes) const {
+  if (directory.empty()) {
+    return;
+  }
+  std::error_code error;
+  vector<std::pair<fs::file_time_type, fs::path>> files;
+  size_t total = 0;
+  for (auto &file : fs::directory_iterator(directory, error)) {
+    if (file.is_regular_file(error)) {
+      total += file.file_size(error);
+      files.push_back({file.last_write_time(error), file.path()});
+    }
+  }
+  if (total <= maxBytes) {
+    return;
+  }
+  // oldest first
+  std::sort(files.begin(), files.end());
+  for (auto &[time, file] : files) {
+    if (total <= maxBytes) {
+      break;
+    }
+    size_t size = fs::file_size(file, error);
+    if (fs::remove(file, error)) {
+      total -= size;
+    }
+  }
+}
+
+uint64_t MeshCache::hash(const void *data, size_t size, uint64_t seed) {
+  const unsigned char *bytes = (const unsigned char *)data;
+  uint64_t h = seed;
+  for (size_t i = 0; i < size; i++) {
+    h ^= bytes[i];
+    h *= 1099511628211ull;
+  }
+  return h;
+}
+
+uint64_t MeshCache::hashFile(const std::string &path) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) {
+    return 0;
+  }
+  uint64_t h = FNV_OFFSET;
+  vector<char> buffer(1 << 16);
+  while (in) {
+    in.read(buffer.data(), buffer.size());
+    h = hash(buffer.data(), in.gcount(), h);
+  }
+  return h;
+}
+
+// ------------------------------------------------------------ mesh files
+
+// Wavefront obj, just what the models here use: v / vt / vn and polygon
+// faces (fanned into triangles), materials and groups are ignored. Corners
+// that repeat the same v/vt/vn are shared.
+static bool importObj(const std::string &path, ofMesh &mesh) {
+  std::ifstream in(path);
+  if (!in) {
+    return false;
+  }
+  vector<glm::vec3> positions, normals;
+  vector<glm::vec2> texCoords;
+  std::unordered_map<uint64_t, ofIndexType> corners;
+  vector<ofIndexType> face;
+
+  // obj indices are 1 based, negative ones count back from the end
+  auto resolve = [](long index, size_t size) -> long {
+    return index < 0 ? (long)size + index : index - 1;
+  };
+
+  std::string line;
+  while (std::getline(in, line)) {
+    const char *p = line.c_str();
+    char *end;
+    if (line.rfind("v ", 0) == 0) {
+      glm::vec3 v;
+      v.x = strtof(p + 2, &end);
+      v.y = strtof(end, &end);
+      v.z = strtof(end, &end);
+      positions.push_back(v);
+    } else if (line.rfind("vn ", 0) == 0) {
+      glm::vec3 n;
+      n.x = strtof(p + 3, &end);
+      n.y = strtof(end, &end);
+      n.z = strtof(end, &end);
+      normals.push_back(n);
+    } else if (line.rfind("vt ", 0) == 0) {
+      glm::vec2 t;
+      t.x = strtof(p + 3, &end);
+      t.y = strtof(end, &end);
+      texCoords.push_back(t);
+    } else if (line.rfind("f ", 0) == 0) {
+      face.clear();
+      p += 2;
+      while (true) {
+        long v = strtol(p, &end, 10), t = 0, n = 0;
+        if (end == p) {
+          break;
+        }
+        p = end;
+        if (*p == '/') {
+          p++;
+          if (*p != '/') {
+            t = strtol(p, &end, 10);
+            p = end;
+          }
+          if (*p == '/') {
+            n = strtol(p + 1, &end, 10);
+            p = end;
+          }
+        }
+        long vi = resolve(v, positions.size());
+        long ti = t ? resolve(t, texCoords.size()) : -1;
+        long ni = n ? resolve(n, normals.size()) : -1;
+        // -1 is "none", a given index that resolves before the start isn't.
+        // The corner key below packs each index (tex coord and normal
+        // shifted up by one) into 21 bits
+        if (vi < 0 || vi >= (long)positions.size() || vi >= 1 << 21 ||
+            ti < (t ? 0 : -1) || ti >= (long)texCoords.size() ||
+            ti + 1 >= 1 << 21 || ni < (n ? 0 : -1) ||
+            ni >= (long)normals.size() || ni + 1 >= 1 << 21) {
+          return false;
+        }
+        uint64_t corner = (uint64_t)vi | (uint64_t)(ti + 1) << 21 |
+                          (uint64_t)(ni + 1) << 42;
+        auto [it, added] =
+            corners.try_emplace(corner, mesh.getVertices().size());
+        if (added) {
+          mesh.getVertices().push_back(positions[vi]);
+          if (!texCoords.empty()) {
+            mesh.getTexCoords().push_back(ti >= 0 ? texCoords[ti]
+                                                  : glm::vec2(0, 0));
+          }
+          if (!normals.empty()) {
+            mesh.getNormals().push_back(ni >= 0 ? normals[ni]
+                                                : glm::vec3(0, 0, 0));
+          }
+        }
+        face.push_back(it->second);
+      }
+      for (size_t i = 2; i < face.size(); i++) {
+        mesh.getIndices().push_back(face[0]);
+        mesh.getIndices().push_back(face[i - 1]);
+        mesh.getIndices().push_back(face[i]);
+      }
+    }
+  }
+  return !mesh.getIndices().empty();
+}
+
+bool MeshCache::loadMesh(const std::string &path, ofMesh &mesh) const {
+  std::string source = ofToDataPath(path);
+  uint64_t key = hashFile(source);
+  if (key == 0) {
+    return false;
+  }
+  std::string name = fs::path(source).filename().string() + ".mesh";
+
+  mesh.clear();
+  Entry entry;
+  if (open(name, key, entry)) {
+    entry.copyTo(mesh);
+    return true;
+  }
+
+  std::string extension = ofToLower(fs::path(source).extension().string());
+  bool imported = false;
+  if (extension == ".ply") {
+    mesh.load(source);
+    imported = !mesh.getVertices().empty();
+  } else if (extension == ".obj") {
+    imported = importObj(source, mesh);
+  }
+  if (!imported) {
+    mesh.clear();
+    return false;
+  }
+  save(name, key,
+       {mesh.getVertices(), mesh.getNormals(), mesh.getTexCoords(),
+        mesh.getIndices()});
+  return true;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "HeightField.hpp"
+#include "ofMain.h"
+#include <span>
+
+// Binary copies of meshes (and height fields) on disk, so a second run maps
+// the file and hands the arrays to the GPU instead of parsing text or
+// evaluating noise again. Every file starts with a header carrying a magic,
+// the format version and a key (a hash of the source file or of whatever the
+// data was generated from); a file whose header doesn't match is treated as
+// missing and written again. The arrays follow the header, each 64 byte
+// aligned, in the layout ofMesh / the VBOs use.
+class MeshCache {
+public:
+  static constexpr uint32_t VERSION = 1; // bump whenever the layout changes
+  static constexpr uint64_t FNV_OFFSET = 14695981039346656037ull;
+
+  // what gets written, any of the arrays can be empty
+  struct Contents {
+    std::span<const glm::vec3> vertices;
+    std::span<const glm::vec3> normals;
+    std::span<const glm::vec2> texCoords;
+    std::span<const ofIndexType> indices;
+    const HeightField *heightField = nullptr;
+  };
+
+  // a cache file mapped read only, the spans point straight into the mapping
+  // and stay valid until the Entry is destroyed or reopened
+  class Entry {
+  public:
+    Entry() = default;
+    Entry(const Entry &) = delete;
+    Entry &operator=(const Entry &) = delete;
+    ~Entry() { close(); }
+
+    bool isOpen() const { return data != nullptr; }
+    void close();
+
+    std::span<const glm::vec3> vertices() const;
+    std::span<const glm::vec3> normals() const;
+    std::span<const glm::vec2> texCoords() const;
+    std::span<const ofIndexType> indices() const;
+    bool hasHeightField() const;
+
+    // copies out of the mapping, one memcpy per array
+    void copyTo(ofMesh &mesh) const;
+    void copyTo(HeightField &heightField) const;
+
+  private:
+    friend class MeshCache;
+    struct Header;
+    const Header &header() const {
+      return *reinterpret_cast<const Header *>(data);
+    }
+    const char *data = nullptr;
+    size_t size = 0;
+  };
+
+  MeshCache() = default;
+  explicit MeshCache(const std::string &directory) { setDirectory(directory); }
+
+  // empty turns the cache off: open() misses and save() does nothing
+  void setDirectory(const std::string &directory);
+  const std::string &getDirectory() const { return directory; }
+
+  // maps directory/name if it's there, valid and was saved under key
+  bool open(const std::string &name, uint64_t key, Entry &entry) const;
+  // writes to a temporary file first and renames it into place, so a reader
+  // never sees half a file
+  bool save(const std::string &name, uint64_t key,
+            const Contents &contents) const;
+  // deletes the least recently used files until the directory takes no more
+  // than maxBytes
+  void trim(size_t maxBytes) const;
+
+  // a mesh file from bin/data through the cache: .ply goes through
+  // ofMesh::load and .obj through a small reader of its own when the cache
+  // misses, both are keyed by the hash of the file's bytes
+  bool loadMesh(const std::string &path, ofMesh &mesh) const;
+
+  // FNV-1a, pass the previous result as seed to hash several things together
+  static uint64_t hash(const void *data, size_t size,
+                       uint64_t seed = FNV_OFFSET);
+  template <class T> static uint64_t hash(const T &value, uint64_t seed) {
+    return hash(&value, sizeof(T), seed);
+  }
+  static uint64_t hashFile(const std::string &path); // 0 if unreadable
+
+private:
+  std::string path(const std::string &name) const;
+
+  std::string directory;
+};
@@ -0,0 +1,78 @@
+#include "ParticleKernels.hpp"
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+ofFloatColor lifeColor(const ParticleForces &forces, float lifeRatio) {
+  const ofFloatColor *c = forces.colors;
+  // mix(half way, birth) over the first half, mix(death, half way) after
+  const ofFloatColor &from = lifeRatio > 0.5f ? c[1] : c[2];
+  const ofFloatColor &to = lifeRatio > 0.5f ? c[0] : c[1];
+  float t = lifeRatio > 0.5f ? (lifeRatio - 0.5f) * 2.0f : lifeRatio * 2.0f;
+  return ofFloatColor(from.r + (to.r - from.r) * t,
+                      from.g + (to.g - from.g) * t,
+                      from.b + (to.b - from.b) * t, lifeRatio);
+}
+
+// the end of a living particle's step, shared by both paths
+static void finish(Particle &p, uint32_t index, const ParticleForces &forces,
+                   vector<uint32_t> &alive, vector<uint32_t> &dead) {
+  if (p.pos.w < 0.0f) {
+    p.col.a = 0;
+    dead.push_back(index);
+  } else {
+    p.col = lifeColor(forces, p.pos.w * p.vel.w);
+    alive.push_back(index);
+  }
+}
+
+#if defined(__SSE2__)
+
+void integrateParticles(Particle *particles, const uint16_t *emitterOf,
+                        const ParticleForces *forces, int begin, int end,
+                        float dt, vector<uint32_t> &alive,
+                        vector<uint32_t> &dead) {
+  // w lanes: velocity's (1 / life) is left alone, life loses dt
+  const __m128 halfDt = _mm_setr_ps(dt / 2, dt / 2, dt / 2, 0);
+  const __m128 lifeStep = _mm_setr_ps(0, 0, 0, dt);
+  for (int i = begin; i < end; i++) {
+    Particle &p = particles[i];
+    if (p.pos.w < 0.0f) {
+      continue;
+    }
+    const ParticleForces &f = forces[emitterOf[i]];
+    __m128 velocityStep =
+        _mm_setr_ps(f.acceleration.x * dt, f.acceleration.y * dt,
+                    f.acceleration.z * dt, 0.0f);
+    __m128 pos = _mm_loadu_ps(&p.pos.x);
+    __m128 vel = _mm_loadu_ps(&p.vel.x);
+    __m128 newVel = _mm_add_ps(vel, velocityStep);
+    pos = _mm_add_ps(pos, _mm_mul_ps(_mm_add_ps(newVel, vel), halfDt));
+    _mm_storeu_ps(&p.vel.x, newVel);
+    _mm_storeu_ps(&p.pos.x, _mm_sub_ps(pos, lifeStep));
+    finish(p, i, f, alive, dead);
+  }
+}
+
+#else
+
+void integrateParticles(Particle *particles, const uint16_t *emitterOf,
+                        const ParticleForces *forces, int begin, int end,
+                        float dt, vector<uint32_t> &alive,
+                        vector<uint32_t> &dead) {
+  for (int i = begin; i < end; i++) {
+    Particle &p = particles[i];
+    if (p.pos.w < 0.0f) {
+      continue;
+    }
+    const ParticleForces &f = forces[emitterOf[i]];
+    glm::vec3 vel = glm::vec3(p.vel) + f.acceleration * dt;
+    glm::vec3 pos = glm::vec3(p.pos) + (vel + glm::vec3(p.vel)) * (dt / 2.0f);
+    p.vel = glm::vec4(vel, p.vel.w);
+    p.pos = glm::vec4(pos, p.pos.w - dt);
+    finish(p, i, f, alive, dead);
+  }
+}
+
+#endif
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "ofMain.h"
+
+// One particle, laid out like the Particle struct of
+// bin/data/particleCompute.glsl (std140, three vec4s) so the same buffer
+// feeds the compute shader, the CPU path and the point draw.
+struct Particle {
+  glm::vec4 pos; // xyz position, w seconds of life left (< 0 once dead)
+  glm::vec4 vel; // xyz velocity, w 1 / the life it started with (CPU path)
+  ofFloatColor col;
+};
+
+// What the step needs from a particle's emitter.
+struct ParticleForces {
+  glm::vec3 acceleration = glm::vec3(0, -8, 0);
+  // at birth, half way, at death
+  ofFloatColor colors[3] = {ofFloatColor(1, 1, 1), ofFloatColor(1, 0, 0),
+                            ofFloatColor(1, 1, 0)};
+};
+
+// colors[0] -> [1] over the first half of the life, [1] -> [2] after, alpha
+// is the share of the life left (particleCompute.glsl's ramp)
+ofFloatColor lifeColor(const ParticleForces &forces, float lifeRatio);
+
+// One step of dt for the pool slots [begin, end). Living particles (pos.w >=
+// 0) get particleCompute.glsl's half-step Verlet update with their emitter's
+// (forces[emitterOf[i]]) acceleration, lose dt of life and are colored by
+// lifeColor. The indices of those still alive get appended to alive, those
+// that ran out get alpha 0 and their indices appended to dead; slots that
+// were dead already are skipped. Uses SSE (a particle's vec4s are one
+// register each) when the compiler targets it.
+void integrateParticles(Particle *particles, const uint16_t *emitterOf,
+                        const ParticleForces *forces, int begin, int end,
+                        float dt, vector<uint32_t> &alive,
+                        vector<uint32_t> &dead);
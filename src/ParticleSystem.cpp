@@ -0,0 +1,91 @@
+#include "ParticleSystem.hpp"
+
+void ParticleSystem::setup(int capacity, uint64_t seed) {
+  this->seed = seed;
+  particles.assign(capacity, Particle());
+  emitterOf.assign(capacity, 0);
+  used = 0;
+  dead.clear();
+  dead.reserve(capacity);
+  alive.clear();
+  alive.reserve(capacity);
+  int numChunks = (capacity + CHUNK - 1) / CHUNK;
+  chunkAlive.resize(numChunks);
+  chunkDead.resize(numChunks);
+  for (int c = 0; c < numChunks; c++) {
+    chunkAlive[c].reserve(CHUNK);
+    chunkDead[c].reserve(CHUNK);
+  }
+}
+
+int ParticleSystem::addEmitter(const Emitter &emitter) {
+  emitters.push_back(emitter);
+  forces.push_back(emitter.forces);
+  rngs.push_back(Rng(seed).split(emitters.size() - 1));
+  owed.push_back(0);
+  return emitters.size() - 1;
+}
+
+void ParticleSystem::update(float dt, ThreadPool &pool) {
+  for (size_t e = 0; e < emitters.size(); e++) {
+    forces[e] = emitters[e].forces;
+  }
+
+  // step whoever is alive, each chunk collects its own survivors and deaths
+  pool.parallelFor(used, CHUNK, [&](int begin, int end) {
+    vector<uint32_t> &chunkLive = chunkAlive[begin / CHUNK];
+    vector<uint32_t> &chunkGone = chunkDead[begin / CHUNK];
+    chunkLive.clear();
+    chunkGone.clear();
+    integrateParticles(particles.data(), emitterOf.data(), forces.data(),
+                       begin, end, dt, chunkLive, chunkGone);
+  });
+  alive.clear();
+  for (int c = 0, numChunks = (used + CHUNK - 1) / CHUNK; c < numChunks; c++) {
+    alive.insert(alive.end(), chunkAlive[c].begin(), chunkAlive[c].end());
+    dead.insert(dead.end(), chunkDead[c].begin(), chunkDead[c].end());
+  }
+
+  for (size_t e = 0; e < emitters.size(); e++) {
+    if (!emitters[e].enabled) {
+      owed[e] = 0;
+      continue;
+    }
+    owed[e] += emitters[e].rate * dt;
+    int count = (int)owed[e];
+    owed[e] -= count;
+    spawn(e, count);
+  }
+}
+
+void ParticleSystem::spawn(int e, int count) {
+  const Emitter &emitter = emitters[e];
+  Rng &rng = rngs[e];
+  for (int i = 0; i < count; i++) {
+    uint32_t slot;
+    if (!dead.empty()) {
+      slot = dead.back();
+      dead.pop_back();
+    } else if (used < (int)particles.size()) {
+      slot = used++;
+    } else {
+      return; // pool is full
+    }
+
+    // one draw per statement, so the order is fixed (see Boid::randomize)
+    float dx = rng.uniform(-emitter.radius, emitter.radius);
+    float dz = rng.uniform(-emitter.radius, emitter.radius);
+    float vx = rng.uniform(emitter.minVelocity.x, emitter.maxVelocity.x);
+    float vy = rng.uniform(emitter.minVelocity.y, emitter.maxVelocity.y);
+    float vz = rng.uniform(emitter.minVelocity.z, emitter.maxVelocity.z);
+    float life = rng.uniform(emitter.minLifeTime, emitter.maxLifeTime);
+    life = std::max(life, 1e-3f);
+
+    Particle &p = particles[slot];
+    p.pos = glm::vec4(emitter.position + glm::vec3(dx, 0, dz), life);
+    p.vel = glm::vec4(vx, vy, vz, 1.0f / life);
+    p.col = lifeColor(emitter.forces, 1.0f);
+    emitterOf[slot] = e;
+    alive.push_back(slot);
+  }
+}
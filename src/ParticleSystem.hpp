@@ -0,0 +1,63 @@
+#pragma once
+
+#include "ParticleKernels.hpp"
+#include "Rng.hpp"
+#include "ThreadPool.hpp"
+#include "ofMain.h"
+
+// CPU particles from any number of emitters (volcano vents, bubbles,
+// sediment, ...) in one fixed pool. The pool is allocated once in setup();
+// particles that die go on a dead list and the next spawn pops a slot off it,
+// so births and deaths are O(1) and nothing moves or reallocates. Stepping
+// runs over the used part of the pool in chunks on a thread pool, and leaves
+// the indices of the living particles behind for an indexed point draw.
+class ParticleSystem {
+public:
+  struct Emitter {
+    glm::vec3 position = glm::vec3(0, 0, 0);
+    float radius = 0;  // spawn anywhere within this of position, on xz
+    float rate = 100;  // particles per second
+    float minLifeTime = 3, maxLifeTime = 3; // seconds
+    glm::vec3 minVelocity = glm::vec3(-15, 10, -15);
+    glm::vec3 maxVelocity = glm::vec3(15, 10, 15);
+    ParticleForces forces; // acceleration and color ramp
+    bool enabled = true;
+  };
+
+  // room for capacity particles at once, spawns past it are dropped. Every
+  // emitter draws from its own stream of seed (see Rng)
+  void setup(int capacity, uint64_t seed = 0);
+  int addEmitter(const Emitter &emitter); // returns its index
+  Emitter &getEmitter(int index) { return emitters[index]; }
+  int numEmitters() const { return emitters.size(); }
+
+  // dt in seconds, the real frame time
+  void update(float dt, ThreadPool &pool);
+
+  // the pool up to the highest slot ever used, dead slots have alpha 0
+  const Particle *getParticles() const { return particles.data(); }
+  int getUsed() const { return used; }
+  int getCapacity() const { return particles.size(); }
+  // indices of the living particles into getParticles()
+  const vector<uint32_t> &getAlive() const { return alive; }
+
+  static constexpr int CHUNK = 4096; // slots per parallelFor chunk
+
+private:
+  void spawn(int emitter, int count);
+
+  vector<Particle> particles;
+  vector<uint16_t> emitterOf; // which emitter each slot's particle came from
+  int used = 0;               // slots [0, used) were handed out at some point
+  vector<uint32_t> dead;      // free slots below used
+  vector<uint32_t> alive;
+
+  vector<Emitter> emitters;
+  vector<ParticleForces> forces; // emitters' forces, packed for the kernel
+  vector<Rng> rngs;              // one stream per emitter
+  vector<float> owed;            // fractional particles carried to next frame
+  uint64_t seed = 0;
+
+  // per chunk results of the parallel step, merged afterwards
+  vector<vector<uint32_t>> chunkAlive, chunkDead;
+};
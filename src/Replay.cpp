@@ -0,0 +1,128 @@
+#include "Replay.hpp"
+#include <cstring>
+
+struct Replay::Header {
+  char magic[8] = {'B', 'O', 'I', 'D', 'R', 'P', 'L', 'Y'};
+  uint32_t version = VERSION;
+  // catches recordings of a build whose params had a different layout
+  uint32_t paramsSize = sizeof(Boid::BoidParams);
+  uint64_t seed = 0;
+};
+
+enum : uint8_t { HAS_PARAMS = 1, HAS_TERRAIN = 2, HAS_MESH = 4 };
+
+template <typename T> static void put(std::ofstream &out, const T &value) {
+  out.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template <typename T> static bool get(std::ifstream &in, T &value) {
+  return (bool)in.read(reinterpret_cast<char *>(&value), sizeof(T));
+}
+
+bool Replay::startRecording(const std::string &path, uint64_t seed) {
+  stopRecording();
+  out.open(path, std::ios::binary | std::ios::trunc);
+  if (!out) {
+    return false;
+  }
+  this->seed = seed;
+  Header header;
+  header.seed = seed;
+  put(out, header);
+  return true;
+}
+
+void Replay::write(const Tick &tick) {
+  put(out, tick.tick);
+  put(out, (uint8_t)((tick.hasParams ? HAS_PARAMS : 0) |
+                     (tick.hasTerrain ? HAS_TERRAIN : 0) |
+                     (tick.hasMesh ? HAS_MESH : 0)));
+  put(out, tick.spawns);
+  put(out, tick.stateHash);
+  if (tick.hasParams) {
+    put(out, tick.boidParams);
+  }
+  if (tick.hasTerrain) {
+    const HeightField &h = tick.heightField;
+    put(out, h.getCols());
+    put(out, h.getRows());
+    put(out, h.getOrigin());
+    put(out, h.getSpacing());
+    out.write(reinterpret_cast<const char *>(h.getHeights().data()),
+              h.getHeights().size() * sizeof(float));
+  }
+  if (tick.hasMesh) {
+    const TriangleMesh &m = tick.mesh;
+    put(out, (uint32_t)m.vertices.size());
+    put(out, (uint32_t)m.indices.size());
+    out.write(reinterpret_cast<const char *>(m.vertices.data()),
+              m.vertices.size() * sizeof(glm::vec3));
+    out.write(reinterpret_cast<const char *>(m.indices.data()),
+              m.indices.size() * sizeof(uint32_t));
+  }
+}
+
+void Replay::stopRecording() {
+  if (out.is_open()) {
+    out.close();
+  }
+}
+
+bool Replay::open(const std::string &path) {
+  in.close();
+  in.clear();
+  in.open(path, std::ios::binary);
+  Header expected, header;
+  if (!in || !get(in, header) ||
+      memcmp(header.magic, expected.magic, sizeof(header.magic)) ||
+      header.version != VERSION || header.paramsSize != expected.paramsSize) {
+    in.close();
+    return false;
+  }
+  seed = header.seed;
+  return true;
+}
+
+bool Replay::read(Tick &tick) {
+  uint8_t flags;
+  if (!get(in, tick.tick) || !get(in, flags) || !get(in, tick.spawns) ||
+      !get(in, tick.stateHash)) {
+    return false;
+  }
+  tick.hasParams = flags & HAS_PARAMS;
+  tick.hasTerrain = flags & HAS_TERRAIN;
+  tick.hasMesh = flags & HAS_MESH;
+  if (tick.hasParams && !get(in, tick.boidParams)) {
+    return false;
+  }
+  if (tick.hasTerrain) {
+    int cols, rows;
+    glm::vec2 origin;
+    float spacing;
+    if (!get(in, cols) || !get(in, rows) || !get(in, origin) ||
+        !get(in, spacing) || cols < 0 || rows < 0) {
+      return false;
+    }
+    tick.heightField.setup(cols, rows, origin, spacing);
+    if (cols * rows > 0 &&
+        !in.read(reinterpret_cast<char *>(&tick.heightField.at(0, 0)),
+                 (size_t)cols * rows * sizeof(float))) {
+      return false;
+    }
+  }
+  if (tick.hasMesh) {
+    uint32_t numVertices, numIndices;
+    if (!get(in, numVertices) || !get(in, numIndices)) {
+      return false;
+    }
+    tick.mesh.vertices.resize(numVertices);
+    tick.mesh.indices.resize(numIndices);
+    if (!in.read(reinterpret_cast<char *>(tick.mesh.vertices.data()),
+                 numVertices * sizeof(glm::vec3)) ||
+        !in.read(reinterpret_cast<char *>(tick.mesh.indices.data()),
+                 numIndices * sizeof(uint32_t))) {
+      return false;
+    }
+  }
+  return true;
+}
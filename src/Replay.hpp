@@ -0,0 +1,52 @@
+#pragma once
+
+#include "Boid.hpp"
+#include "HeightField.hpp"
+#include "TriangleBVH.hpp"
+#include "ofMain.h"
+#include <fstream>
+
+// A recording of everything that went into a Simulation from outside: the
+// seed, and for every tick the params, terrain and spawns that tick took in.
+// The simulation itself is deterministic (counter based randomness, each boid
+// only writes itself while stepping), so feeding the same inputs back tick
+// by tick reproduces the run bit for bit on any thread count. Every tick also
+// carries a hash of all boids after it, so a replay can tell the first tick
+// a build started behaving differently.
+class Replay {
+public:
+  static constexpr uint32_t VERSION = 4; // bump whenever the layout changes
+
+  // one tick's inputs, params / heightField / mesh only when they changed
+  struct Tick {
+    uint64_t tick = 0;
+    bool hasParams = false;
+    Boid::BoidParams boidParams;
+    bool hasTerrain = false;
+    HeightField heightField;
+    bool hasMesh = false;
+    TriangleMesh mesh; // Simulation::setCollisionMesh
+    int spawns[3] = {0, 0, 0}; // by Simulation::FlockId
+    uint64_t stateHash = 0;
+  };
+
+  // recording, overwrites path
+  bool startRecording(const std::string &path, uint64_t seed);
+  void write(const Tick &tick);
+  void stopRecording();
+  bool isRecording() const { return out.is_open(); }
+
+  // playback, false if path isn't a replay of this VERSION
+  bool open(const std::string &path);
+  bool read(Tick &tick); // the next one, false at the end
+  bool isPlaying() const { return in.is_open(); }
+
+  uint64_t getSeed() const { return seed; }
+
+private:
+  struct Header;
+
+  std::ofstream out;
+  std::ifstream in;
+  uint64_t seed = 0;
+};
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+
+// Counter based random numbers: the n-th number of a stream is a hash of
+// (key, n), so nothing but the counter is carried from one draw to the next.
+// split() derives an independent stream per whatever (a flock, a boid, a
+// thread, a chunk) from the parent's key, so work can be spread over threads
+// and still draw exactly the same numbers as a serial run. Everything the
+// simulation spawns draws from streams rooted in one seed (see
+// Simulation::setSeed), unlike ofRandom's global state.
+//
+// The hash is SplitMix64's finalizer over a Weyl sequence, streams get their
+// key by running the same finalizer over the parent key and the stream id.
+class Rng {
+public:
+  static constexpr uint64_t GOLDEN = 0x9e3779b97f4a7c15ull;
+
+  explicit Rng(uint64_t seed = 0, uint64_t stream = 0)
+      : key(mix(mix(seed) ^ (stream * GOLDEN + 1))) {}
+
+  static uint64_t mix(uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+  }
+
+  // a stream of its own, the same every time for the same parent and id
+  Rng split(uint64_t stream) const { return Rng(key, stream); }
+
+  // the n-th number, doesn't touch the counter
+  uint64_t at(uint64_t n) const { return mix(key + (n + 1) * GOLDEN); }
+  uint64_t next() { return at(counter++); }
+
+  // [0, 1) with 24 bits, all of a float's mantissa
+  float uniform() { return (next() >> 40) * (1.0f / 16777216.0f); }
+  // [lo, hi), same arguments as ofRandom
+  float uniform(float lo, float hi) { return lo + (hi - lo) * uniform(); }
+  float uniform(float hi) { return uniform(0, hi); }
+
+  uint64_t getCounter() const { return counter; }
+
+private:
+  uint64_t key;
+  uint64_t counter = 0;
+};
@@ -0,0 +1,320 @@
+#include "Simulation.hpp"
+#include <cstring>
+
+Simulation::Simulation() { setSeed(0); }
+
+Simulation::~Simulation() {
+  stop();
+  recording.stopRecording();
+}
+
+double Simulation::now() {
+  return std::chrono::duration<double>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+Flock &Simulation::getFlock(FlockId id) {
+  switch (id) {
+  case PREDATORS:
+    return predators;
+  case FOOD:
+    return food;
+  default:
+    return flock;
+  }
+}
+
+void Simulation::setSeed(uint64_t seed) {
+  this->seed = seed;
+  // a stream per flock, each boid gets its own off that (see generateFlock)
+  for (int id = 0; id < NUM_FLOCKS; id++) {
+    Flock &f = getFlock((FlockId)id);
+    f.rng = Rng(seed, id);
+    f.spawned = 0;
+  }
+}
+
+bool Simulation::record(const std::string &path) {
+  collisionChanged = !collisions.readBuffer().field.empty();
+  paramsRecorded = false;
+  return recording.startRecording(path, seed);
+}
+
+bool Simulation::replay(const std::string &path) {
+  if (!playback.open(path)) {
+    return false;
+  }
+  setSeed(playback.getSeed());
+  divergence = -1;
+  return true;
+}
+
+bool Simulation::stepReplay() {
+  Replay::Tick &recorded = playbackTick;
+  if (!playback.isPlaying() || !playback.read(recorded)) {
+    return false;
+  }
+  // the same calls the render thread would have made before this tick
+  if (recorded.hasParams) {
+    setParams({recorded.boidParams});
+  }
+  if (recorded.hasTerrain) {
+    setHeightField(recorded.heightField);
+  }
+  if (recorded.hasMesh) {
+    setCollisionMesh(recorded.mesh);
+  }
+  for (int id = 0; id < NUM_FLOCKS; id++) {
+    if (recorded.spawns[id] > 0) {
+      spawn((FlockId)id, recorded.spawns[id]);
+    }
+  }
+  step();
+  if (divergence < 0 && stateHash() != recorded.stateHash) {
+    divergence = recorded.tick;
+  }
+  return true;
+}
+
+uint64_t Simulation::stateHash() const {
+  uint64_t hash = seed;
+  auto add = [&](float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    hash = Rng::mix(hash ^ bits);
+  };
+  for (const Flock *f : {&flock, &predators, &food}) {
+    hash = Rng::mix(hash ^ f->boids.size());
+    for (size_t i = 0; i < f->boids.size(); i++) {
+      add(f->hot.px[i]);
+      add(f->hot.vx[i]);
+      add(f->hot.py[i]);
+      add(f->hot.vy[i]);
+      add(f->hot.pz[i]);
+      add(f->hot.vz[i]);
+      hash = Rng::mix(hash ^ (uint32_t)f->boids[i].health);
+    }
+  }
+  return hash;
+}
+
+void Simulation::start() {
+  if (running) {
+    return;
+  }
+  publish(now());
+  running = true;
+  if (!bakePool) {
+    bakePool = std::make_unique<ThreadPool>();
+  }
+  baker = std::thread([this] { bakerFunction(); });
+  thread = std::thread([this] { threadedFunction(); });
+}
+
+void Simulation::stop() {
+  {
+    std::lock_guard<std::mutex> lock(bakeMutex);
+    running = false;
+  }
+  bakeWake.notify_one();
+  if (thread.joinable()) {
+    thread.join();
+  }
+  if (baker.joinable()) {
+    baker.join();
+  }
+}
+
+void Simulation::bake(Collision &collision, ThreadPool &pool) {
+  if (collision.heightField.empty() && collision.mesh.empty()) {
+    collision.field.clear(); // nothing to collide with
+    return;
+  }
+  TriangleBVH bvh;
+  bvh.build(collision.mesh.empty()
+                ? TriangleMesh::fromHeightField(collision.heightField)
+                : collision.mesh);
+  collision.field.build(bvh, TERRAIN_CEILING, DistanceField::Settings(), pool);
+}
+
+void Simulation::bakerFunction() {
+  std::unique_lock<std::mutex> lock(bakeMutex);
+  while (true) {
+    bakeWake.wait(lock, [this] { return bakePending || !running; });
+    if (!running) {
+      return;
+    }
+    Collision &collision = collisions.writeBuffer();
+    std::swap(collision.heightField, bakeHeightField);
+    std::swap(collision.mesh, bakeMesh);
+    bakePending = false;
+    lock.unlock();
+    bake(collision, *bakePool);
+    collisions.publish();
+    lock.lock();
+  }
+}
+
+void Simulation::threadedFunction() {
+  using clock = std::chrono::steady_clock;
+  auto timestep = std::chrono::duration_cast<clock::duration>(
+      std::chrono::duration<double>(TIMESTEP));
+  auto nextTick = clock::now();
+
+  while (running) {
+    int steps = 0;
+    while (clock::now() >= nextTick && steps < MAX_CATCH_UP_STEPS) {
+      step();
+      nextTick += timestep;
+      steps++;
+    }
+    if (steps > 0) {
+      auto tickTime = nextTick - timestep;
+      publish(std::chrono::duration<double>(tickTime.time_since_epoch()).count());
+    }
+    if (steps == MAX_CATCH_UP_STEPS) {
+      // a tick takes longer than TIMESTEP, drop the backlog instead of
+      // spiraling further behind
+      nextTick = std::max(nextTick, clock::now());
+    }
+    std::this_thread::sleep_until(nextTick);
+  }
+}
+
+void Simulation::step() {
+  if (params.update()) {
+    // republished every frame, the flocks' versions only move on changes
+    haveParams = true;
+    for (Flock *f : {&flock, &predators, &food}) {
+      f->setParams(params.readBuffer().boidParams);
+    }
+  }
+  bool terrainChanged = terrain.update();
+  bool meshChanged = collisionMeshes.update();
+  if (terrainChanged || meshChanged) {
+    if (running) {
+      // a bake takes many ticks, the baker hands it over when it's done
+      std::lock_guard<std::mutex> lock(bakeMutex);
+      bakeHeightField = terrain.readBuffer();
+      bakeMesh = collisionMeshes.readBuffer();
+      bakePending = true;
+      bakeWake.notify_one();
+    } else {
+      // stepped by hand (benchmark, replay): right away, so a recording's
+      // new terrain lands on the same tick every time
+      Collision &collision = collisions.writeBuffer();
+      collision.heightField = terrain.readBuffer();
+      collision.mesh = collisionMeshes.readBuffer();
+      bake(collision, ThreadPool::shared());
+      collisions.publish();
+    }
+  }
+  if (collisions.update()) {
+    collisionChanged = true;
+  }
+  const Collision &collision = collisions.readBuffer();
+  if (collision.field.empty()) {
+    return; // nothing to collide with yet
+  }
+
+  int spawned[NUM_FLOCKS];
+  for (int id = 0; id < NUM_FLOCKS; id++) {
+    int count = pendingSpawns[id].exchange(0);
+    spawned[id] = count;
+    if (count > 0) {
+      getFlock((FlockId)id).generateFlock(count);
+    }
+  }
+
+  // everyone reacts to where the others were when the tick started, so the
+  // flocks could step in any order
+  float cellSize = 0;
+  for (Flock *f : {&flock, &predators, &food}) {
+    if (!f->boids.empty()) {
+      const Boid::KindParams &p = f->getParams();
+      cellSize = std::max({cellSize, p.visionRadius, p.interactionRadius});
+    }
+  }
+  for (Flock *f : {&flock, &predators, &food}) {
+    interactions.build(f->kind, f->hot, cellSize);
+  }
+
+  flock.step(interactions, collision.field);
+  predators.step(interactions, collision.field);
+  food.step(interactions, collision.field);
+
+  // whoever died this tick (eaten, starved, inside the terrain) goes now, so
+  // the published copy and the next tick only see the living
+  for (Flock *f : {&flock, &predators, &food}) {
+    f->compact();
+  }
+
+  if (recording.isRecording()) {
+    Replay::Tick recorded;
+    recorded.tick = tick;
+    // params get republished every frame, only write actual changes
+    uint64_t paramsVersion = flock.getParamsVersion() +
+                             predators.getParamsVersion() +
+                             food.getParamsVersion();
+    if (haveParams &&
+        (!paramsRecorded || paramsVersion != recordedParamsVersion)) {
+      recorded.hasParams = true;
+      recorded.boidParams = params.readBuffer().boidParams;
+      recordedParamsVersion = paramsVersion;
+      paramsRecorded = true;
+    }
+    // both, whenever a bake was picked up: that's the tick playback has to
+    // switch fields on too
+    if (collisionChanged) {
+      recorded.hasTerrain = true;
+      recorded.heightField = collision.heightField;
+      recorded.hasMesh = true;
+      recorded.mesh = collision.mesh;
+    }
+    std::copy(spawned, spawned + NUM_FLOCKS, recorded.spawns);
+    recorded.stateHash = stateHash();
+    recording.write(recorded);
+    collisionChanged = false;
+  }
+  tick++;
+}
+
+unsigned long Simulation::neighborChecks() const {
+  return flock.neighborChecks + predators.neighborChecks + food.neighborChecks;
+}
+
+void Simulation::publish(double tickTime) {
+  Snapshot &snapshot = snapshots.writeBuffer();
+  // assigning into the old copies reuses their storage
+  flock.snapshot(snapshot.prey);
+  predators.snapshot(snapshot.predators);
+  food.snapshot(snapshot.food);
+  snapshot.tickTime = tickTime;
+  snapshot.tick = tick;
+  snapshots.publish();
+}
+
+void Simulation::setParams(const Params &p) {
+  params.writeBuffer() = p;
+  params.publish();
+}
+
+void Simulation::setHeightField(const HeightField &heightField) {
+  terrain.writeBuffer() = heightField;
+  terrain.publish();
+}
+
+void Simulation::setCollisionMesh(const TriangleMesh &mesh) {
+  collisionMeshes.writeBuffer() = mesh;
+  collisionMeshes.publish();
+}
+
+void Simulation::spawn(FlockId id, int count) { pendingSpawns[id] += count; }
+
+const Simulation::Snapshot &Simulation::latestSnapshot(float &alpha) {
+  snapshots.update();
+  const Snapshot &snapshot = snapshots.readBuffer();
+  alpha = ofClamp((now() - snapshot.tickTime) / TIMESTEP, 0, 1);
+  return snapshot;
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+#include "Boid.hpp"
+#include "DistanceField.hpp"
+#include "Flock.hpp"
+#include "HeightField.hpp"
+#include "InteractionIndex.hpp"
+#include "Replay.hpp"
+#include "TriangleBVH.hpp"
+#include "TripleBuffer.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// Steps flock, predators and food at a fixed rate on a thread of its own.
+// The render thread only sees copies published through a triple buffer and
+// hands params / terrain / spawn requests back the same way, so neither side
+// ever blocks on the other. New terrain is baked into a distance field on a
+// third thread, the ticks go on with the old one until it's done.
+class Simulation {
+public:
+  static constexpr double TIMESTEP = 1.0 / 60.0; // seconds per tick
+  // ticks run back to back when we fall behind before dropping time instead
+  static constexpr int MAX_CATCH_UP_STEPS = 5;
+
+  enum FlockId { PREY, PREDATORS, FOOD, NUM_FLOCKS };
+
+  // the sliders, each flock takes its kind's share (see Flock::setParams).
+  // The debug overlay toggles (Boid::Features) never come through here, the
+  // render thread draws those itself
+  struct Params {
+    Boid::BoidParams boidParams;
+  };
+
+  struct Snapshot {
+    FlockSnapshot prey, predators, food;
+    double tickTime = 0; // now() of the tick this state belongs to
+    unsigned long tick = 0;
+  };
+
+  Simulation();
+  ~Simulation();
+
+  // touched only by the simulation thread once start() was called
+  Flock flock, predators, food;
+  InteractionIndex interactions; // all three, rebuilt at the start of a tick
+
+  // roots every random draw of the run (see Rng), call before anything is
+  // spawned
+  void setSeed(uint64_t seed);
+  uint64_t getSeed() const { return seed; }
+  // writes the seed and every tick's inputs to path (see Replay). Call before
+  // start() and before spawning anything, a recording has to start from an
+  // empty simulation
+  bool record(const std::string &path);
+
+  // plays a recording back instead of taking inputs from a render thread, on
+  // the calling thread and without start(). Reseeds, so call it on a fresh
+  // Simulation
+  bool replay(const std::string &path);
+  // feeds the next recorded tick's inputs in and steps, false once the
+  // recording ran out
+  bool stepReplay();
+  // first replayed tick whose boids hashed differently than when it was
+  // recorded, -1 while they all matched
+  long firstDivergence() const { return divergence; }
+  // of every boid's position, velocity and health, in order
+  uint64_t stateHash() const;
+
+  // the tick thread and the baker
+  void start();
+  void stop();
+  // one tick on the calling thread, used by the simulation thread (and the
+  // headless benchmark, which never calls start())
+  void step();
+  unsigned long neighborChecks() const;
+
+  // render thread side
+  void setParams(const Params &params);
+  void setHeightField(const HeightField &heightField);
+  // arbitrary geometry to collide with instead of the height field (world
+  // units). Baked into the distance field like the height field. An empty
+  // mesh goes back to the height field.
+  void setCollisionMesh(const TriangleMesh &mesh);
+  void spawn(FlockId id, int count);
+  // newest published state, alpha says how far to blend each boid from its
+  // previous position to position
+  const Snapshot &latestSnapshot(float &alpha);
+
+  static double now();
+
+private:
+  // what the boids collide with: the height field or mesh and the distance
+  // field baked from them
+  struct Collision {
+    HeightField heightField;
+    TriangleMesh mesh;
+    DistanceField field;
+  };
+
+  // the mesh if there is one, the height field as triangles otherwise
+  static void bake(Collision &collision, ThreadPool &pool);
+  void bakerFunction();
+  void threadedFunction();
+  void publish(double tickTime);
+  Flock &getFlock(FlockId id);
+
+  std::thread thread;
+  std::atomic<bool> running{false};
+  unsigned long tick = 0;
+  bool haveParams = false;
+
+  TripleBuffer<Params> params;
+  TripleBuffer<HeightField> terrain;
+  TripleBuffer<TriangleMesh> collisionMeshes;
+  TripleBuffer<Collision> collisions; // baked, the newest is picked up per tick
+  TripleBuffer<Snapshot> snapshots;
+
+  // the baker, once start()ed (stepping without it bakes inline). Only the
+  // newest terrain / mesh waits, a slider drag doesn't queue up bakes.
+  std::thread baker;
+  std::unique_ptr<ThreadPool> bakePool; // not the shared one, see Terrain
+  std::mutex bakeMutex;
+  std::condition_variable bakeWake;
+  HeightField bakeHeightField; // guarded by bakeMutex
+  TriangleMesh bakeMesh;       // guarded by bakeMutex
+  bool bakePending = false;    // guarded by bakeMutex
+  std::atomic<int> pendingSpawns[NUM_FLOCKS] = {0, 0, 0};
+
+  uint64_t seed = 0;
+  Replay recording, playback;
+  Replay::Tick playbackTick; // reused, keeps the height field's storage
+  // the flocks' params versions added up when params were last recorded,
+  // they only ever go up so any change moves the sum
+  uint64_t recordedParamsVersion = 0;
+  bool paramsRecorded = false;
+  // a new Collision was picked up since last recorded
+  bool collisionChanged = false;
+  long divergence = -1;
+};
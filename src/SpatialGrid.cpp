@@ -0,0 +1,54 @@
+#include "SpatialGrid.hpp"
+
+void SpatialGrid::build(const BoidSoA &boids, float maxRadius) {
+  // cells have to cover the largest radius any boid queries with
+  maxRadius = std::max(maxRadius, 1.0f);
+  for (int axis = 0; axis < 3; axis++) {
+    float extent = boundsMax[axis] - boundsMin[axis];
+    dims[axis] = std::clamp((int)(extent / maxRadius), 1, MAX_CELLS_PER_AXIS);
+    cellSize[axis] = extent / dims[axis];
+    invCellSize[axis] = 1.0f / cellSize[axis];
+  }
+
+  // counting sort of the boid indices by cell
+  int n = (int)boids.size();
+  int numCells = getNumCells();
+  cellStart.assign(numCells + 1, 0);
+  boidCell.resize(n);
+  for (int i = 0; i < n; i++) {
+    int cell = (cellCoord(boids.pz[i], 2) * dims[1] + cellCoord(boids.py[i], 1)) *
+                   dims[0] +
+               cellCoord(boids.px[i], 0);
+    boidCell[i] = cell;
+    cellStart[cell + 1]++;
+  }
+  for (int c = 0; c < numCells; c++) {
+    cellStart[c + 1] += cellStart[c];
+  }
+  cellEntries.resize(n);
+  boidSlot.resize(n);
+  // cellStart[c] is used as the write cursor for cell c, then shifted back
+  for (int i = 0; i < n; i++) {
+    int slot = cellStart[boidCell[i]]++;
+    cellEntries[slot] = i;
+    boidSlot[i] = slot;
+  }
+  for (int c = numCells; c > 0; c--) {
+    cellStart[c] = cellStart[c - 1];
+  }
+  cellStart[0] = 0;
+
+  for (auto *v : {&sortedPx, &sortedPy, &sortedPz, &sortedVx, &sortedVy,
+                  &sortedVz}) {
+    v->resize(n);
+  }
+  for (int slot = 0; slot < n; slot++) {
+    int i = cellEntries[slot];
+    sortedPx[slot] = boids.px[i];
+    sortedPy[slot] = boids.py[i];
+    sortedPz[slot] = boids.pz[i];
+    sortedVx[slot] = boids.vx[i];
+    sortedVy[slot] = boids.vy[i];
+    sortedVz[slot] = boids.vz[i];
+  }
+}
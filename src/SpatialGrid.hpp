@@ -0,0 +1,76 @@
+#pragma once
+
+#include "BoidSoA.hpp"
+#include "ofMain.h"
+
+// Uniform grid (cell list) over the box the boids wrap around in. Rebuilt
+// once per tick; cells are at least as large as the biggest flocking radius
+// so a neighbor query only has to look at the surrounding 3x3x3 block of
+// cells.
+// Positions and velocities are copied out in cell order, so each cell is a
+// contiguous run the SIMD kernels can stream through.
+class SpatialGrid {
+public:
+  // world box the boids wrap around in (see integrateBoids)
+  glm::vec3 boundsMin = glm::vec3(-375, -100, -375);
+  glm::vec3 boundsMax = glm::vec3(375, 0, 375);
+
+  // keep the cell count bounded when the radii sliders go very small
+  static constexpr int MAX_CELLS_PER_AXIS = 64;
+
+  // maxRadius is the largest radius anyone will query with
+  void build(const BoidSoA &boids, float maxRadius);
+
+  // Calls fn(begin, end) for every non-empty run of sorted slots (read
+  // through sorted()) in the cells around pos. The block stops at the box
+  // edges since distances aren't wrapped either, callers still do the exact
+  // distance test.
+  template <typename Fn>
+  void forEachNeighborRange(const glm::vec3 &pos, Fn &&fn) const {
+    if (cellStart.empty()) {
+      return;
+    }
+    int cx = cellCoord(pos.x, 0);
+    int cy = cellCoord(pos.y, 1);
+    int cz = cellCoord(pos.z, 2);
+    int x0 = std::max(cx - 1, 0), x1 = std::min(cx + 1, dims[0] - 1);
+    int y0 = std::max(cy - 1, 0), y1 = std::min(cy + 1, dims[1] - 1);
+    int z0 = std::max(cz - 1, 0), z1 = std::min(cz + 1, dims[2] - 1);
+    for (int z = z0; z <= z1; z++) {
+      for (int y = y0; y <= y1; y++) {
+        // cells along x are adjacent, so the whole row is one run
+        int row = (z * dims[1] + y) * dims[0];
+        if (cellStart[row + x0] < cellStart[row + x1 + 1]) {
+          fn(cellStart[row + x0], cellStart[row + x1 + 1]);
+        }
+      }
+    }
+  }
+
+  NeighborArrays sorted() const {
+    return {sortedPx.data(), sortedPy.data(), sortedPz.data(),
+            sortedVx.data(), sortedVy.data(), sortedVz.data()};
+  }
+  // sorted slot of boid i
+  int slotOf(int i) const { return boidSlot[i]; }
+
+  float getCellSize(int axis) const { return cellSize[axis]; }
+  int getNumCells() const { return dims[0] * dims[1] * dims[2]; }
+
+private:
+  int cellCoord(float v, int axis) const {
+    int c = (int)((v - boundsMin[axis]) * invCellSize[axis]);
+    return std::clamp(c, 0, dims[axis] - 1);
+  }
+
+  int dims[3] = {1, 1, 1};
+  float cellSize[3] = {1, 1, 1};
+  float invCellSize[3] = {1, 1, 1};
+
+  vector<int> cellStart;   // numCells + 1 offsets into cellEntries
+  vector<int> cellEntries; // boid indices sorted by cell
+  vector<int> boidSlot;    // inverse of cellEntries
+  vector<int> boidCell;    // scratch: cell of each boid during build
+  vector<float> sortedPx, sortedPy, sortedPz;
+  vector<float> sortedVx, sortedVy, sortedVz;
+};
@@ -0,0 +1,308 @@
+#include "SteeringKernels.hpp"
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+static void accumulateFlockingScalar(const NeighborArrays &n, int begin,
+                                     int end, int self, const glm::vec3 &pos,
+                                     float sepRadius2, float aliRadius2,
+                                     float cohRadius2, FlockingSums &sums) {
+  for (int j = begin; j < end; j++) {
+    if (j == self) {
+      continue;
+    }
+    glm::vec3 diff = pos - glm::vec3(n.px[j], n.py[j], n.pz[j]);
+    float dist2 = glm::dot(diff, diff);
+    if (dist2 < sepRadius2 && dist2 > 0) {
+      sums.separation += diff / dist2;
+      sums.separationCount++;
+    }
+    if (dist2 < aliRadius2) {
+      sums.alignment += glm::vec3(n.vx[j], n.vy[j], n.vz[j]);
+      sums.alignmentCount++;
+    }
+    if (dist2 < cohRadius2) {
+      sums.cohesion += glm::vec3(n.px[j], n.py[j], n.pz[j]);
+      sums.cohesionCount++;
+    }
+  }
+}
+
+static void integrateBoidsScalar(BoidSoA &soa, int begin, int end,
+                                 float maxSpeed, const glm::vec3 &boundsMin,
+                                 const glm::vec3 &boundsMax) {
+  float *p[3] = {soa.px.data(), soa.py.data(), soa.pz.data()};
+  float *v[3] = {soa.vx.data(), soa.vy.data(), soa.vz.data()};
+  float *a[3] = {soa.ax.data(), soa.ay.data(), soa.az.data()};
+  for (int i = begin; i < end; i++) {
+    for (int k = 0; k < 3; k++) {
+      v[k][i] += a[k][i];
+      a[k][i] = 0;
+    }
+    float speed2 = v[0][i] * v[0][i] + v[1][i] * v[1][i] + v[2][i] * v[2][i];
+    float scale =
+        speed2 > maxSpeed * maxSpeed ? maxSpeed / sqrtf(speed2) : 1.0f;
+    for (int k = 0; k < 3; k++) {
+      v[k][i] *= scale;
+      p[k][i] += v[k][i];
+      // wrap around to the other side of the box
+      if (p[k][i] > boundsMax[k]) {
+        p[k][i] = boundsMin[k];
+      } else if (p[k][i] < boundsMin[k]) {
+        p[k][i] = boundsMax[k];
+      }
+    }
+  }
+}
+
+#if defined(__AVX2__) && defined(__FMA__)
+
+static float hsum(__m256 v) {
+  __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+  s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+  s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+  return _mm_cvtss_f32(s);
+}
+
+void accumulateFlocking(const NeighborArrays &n, int begin, int end, int self,
+                        const glm::vec3 &pos, float sepRadius2,
+                        float aliRadius2, float cohRadius2,
+                        FlockingSums &sums) {
+  const __m256 qx = _mm256_set1_ps(pos.x), qy = _mm256_set1_ps(pos.y),
+               qz = _mm256_set1_ps(pos.z);
+  const __m256 sepR2 = _mm256_set1_ps(sepRadius2),
+               aliR2 = _mm256_set1_ps(aliRadius2),
+               cohR2 = _mm256_set1_ps(cohRadius2);
+  const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f);
+  const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  const __m256i selfIndex = _mm256_set1_epi32(self);
+
+  __m256 sepX = zero, sepY = zero, sepZ = zero;
+  __m256 aliX = zero, aliY = zero, aliZ = zero;
+  __m256 cohX = zero, cohY = zero, cohZ = zero;
+  int sepCount = 0, aliCount = 0, cohCount = 0;
+
+  int j = begin;
+  for (; j + 8 <= end; j += 8) {
+    __m256 ox = _mm256_loadu_ps(n.px + j), oy = _mm256_loadu_ps(n.py + j),
+           oz = _mm256_loadu_ps(n.pz + j);
+    __m256 dx = _mm256_sub_ps(qx, ox), dy = _mm256_sub_ps(qy, oy),
+           dz = _mm256_sub_ps(qz, oz);
+    __m256 dist2 = _mm256_fmadd_ps(
+        dx, dx, _mm256_fmadd_ps(dy, dy, _mm256_mul_ps(dz, dz)));
+
+    __m256i index = _mm256_add_epi32(_mm256_set1_epi32(j), lanes);
+    __m256 isSelf =
+        _mm256_castsi256_ps(_mm256_cmpeq_epi32(index, selfIndex));
+
+    __m256 sepMask = _mm256_andnot_ps(
+        isSelf, _mm256_and_ps(_mm256_cmp_ps(dist2, sepR2, _CMP_LT_OQ),
+                              _mm256_cmp_ps(dist2, zero, _CMP_GT_OQ)));
+    __m256 aliMask =
+        _mm256_andnot_ps(isSelf, _mm256_cmp_ps(dist2, aliR2, _CMP_LT_OQ));
+    __m256 cohMask =
+        _mm256_andnot_ps(isSelf, _mm256_cmp_ps(dist2, cohR2, _CMP_LT_OQ));
+
+    // masking the reciprocal also drops the inf from dist2 == 0 lanes
+    __m256 inv = _mm256_and_ps(sepMask, _mm256_div_ps(one, dist2));
+    sepX = _mm256_fmadd_ps(dx, inv, sepX);
+    sepY = _mm256_fmadd_ps(dy, inv, sepY);
+    sepZ = _mm256_fmadd_ps(dz, inv, sepZ);
+
+    aliX = _mm256_add_ps(aliX, _mm256_and_ps(aliMask, _mm256_loadu_ps(n.vx + j)));
+    aliY = _mm256_add_ps(aliY, _mm256_and_ps(aliMask, _mm256_loadu_ps(n.vy + j)));
+    aliZ = _mm256_add_ps(aliZ, _mm256_and_ps(aliMask, _mm256_loadu_ps(n.vz + j)));
+
+    cohX = _mm256_add_ps(cohX, _mm256_and_ps(cohMask, ox));
+    cohY = _mm256_add_ps(cohY, _mm256_and_ps(cohMask, oy));
+    cohZ = _mm256_add_ps(cohZ, _mm256_and_ps(cohMask, oz));
+
+    sepCount += __builtin_popcount(_mm256_movemask_ps(sepMask));
+    aliCount += __builtin_popcount(_mm256_movemask_ps(aliMask));
+    cohCount += __builtin_popcount(_mm256_movemask_ps(cohMask));
+  }
+
+  sums.separation += glm::vec3(hsum(sepX), hsum(sepY), hsum(sepZ));
+  sums.alignment += glm::vec3(hsum(aliX), hsum(aliY), hsum(aliZ));
+  sums.cohesion += glm::vec3(hsum(cohX), hsum(cohY), hsum(cohZ));
+  sums.separationCount += sepCount;
+  sums.alignmentCount += aliCount;
+  sums.cohesionCount += cohCount;
+
+  accumulateFlockingScalar(n, j, end, self, pos, sepRadius2, aliRadius2,
+                           cohRadius2, sums);
+}
+
+void integrateBoids(BoidSoA &soa, int begin, int end, float maxSpeed,
+                    const glm::vec3 &boundsMin, const glm::vec3 &boundsMax) {
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 limit = _mm256_set1_ps(maxSpeed),
+               limit2 = _mm256_set1_ps(maxSpeed * maxSpeed);
+  const __m256 lo[3] = {_mm256_set1_ps(boundsMin.x), _mm256_set1_ps(boundsMin.y),
+                        _mm256_set1_ps(boundsMin.z)};
+  const __m256 hi[3] = {_mm256_set1_ps(boundsMax.x), _mm256_set1_ps(boundsMax.y),
+                        _mm256_set1_ps(boundsMax.z)};
+  float *p[3] = {soa.px.data(), soa.py.data(), soa.pz.data()};
+  float *v[3] = {soa.vx.data(), soa.vy.data(), soa.vz.data()};
+  float *a[3] = {soa.ax.data(), soa.ay.data(), soa.az.data()};
+
+  int i = begin;
+  for (; i + 8 <= end; i += 8) {
+    __m256 vel[3];
+    for (int k = 0; k < 3; k++) {
+      vel[k] = _mm256_add_ps(_mm256_loadu_ps(v[k] + i), _mm256_loadu_ps(a[k] + i));
+      _mm256_storeu_ps(a[k] + i, zero);
+    }
+    __m256 speed2 = _mm256_fmadd_ps(
+        vel[0], vel[0],
+        _mm256_fmadd_ps(vel[1], vel[1], _mm256_mul_ps(vel[2], vel[2])));
+    __m256 tooFast = _mm256_cmp_ps(speed2, limit2, _CMP_GT_OQ);
+    __m256 scale = _mm256_blendv_ps(
+        _mm256_set1_ps(1.0f), _mm256_div_ps(limit, _mm256_sqrt_ps(speed2)),
+        tooFast);
+    for (int k = 0; k < 3; k++) {
+      vel[k] = _mm256_mul_ps(vel[k], scale);
+      _mm256_storeu_ps(v[k] + i, vel[k]);
+      __m256 pos = _mm256_add_ps(_mm256_loadu_ps(p[k] + i), vel[k]);
+      // wrap around to the other side of the box
+      __m256 over = _mm256_cmp_ps(pos, hi[k], _CMP_GT_OQ);
+      __m256 under = _mm256_cmp_ps(pos, lo[k], _CMP_LT_OQ);
+      pos = _mm256_blendv_ps(pos, hi[k], under);
+      pos = _mm256_blendv_ps(pos, lo[k], over);
+      _mm256_storeu_ps(p[k] + i, pos);
+    }
+  }
+
+  integrateBoidsScalar(soa, i, end, maxSpeed, boundsMin, boundsMax);
+}
+
+#elif defined(__SSE2__)
+
+static __m128 select(__m128 mask, __m128 a, __m128 b) {
+  return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+static float hsum(__m128 s) {
+  s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+  s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+  return _mm_cvtss_f32(s);
+}
+
+void accumulateFlocking(const NeighborArrays &n, int begin, int end, int self,
+                        const glm::vec3 &pos, float sepRadius2,
+                        float aliRadius2, float cohRadius2,
+                        FlockingSums &sums) {
+  const __m128 qx = _mm_set1_ps(pos.x), qy = _mm_set1_ps(pos.y),
+               qz = _mm_set1_ps(pos.z);
+  const __m128 sepR2 = _mm_set1_ps(sepRadius2), aliR2 = _mm_set1_ps(aliRadius2),
+               cohR2 = _mm_set1_ps(cohRadius2);
+  const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+  const __m128i lanes = _mm_setr_epi32(0, 1, 2, 3);
+  const __m128i selfIndex = _mm_set1_epi32(self);
+
+  __m128 sepX = zero, sepY = zero, sepZ = zero;
+  __m128 aliX = zero, aliY = zero, aliZ = zero;
+  __m128 cohX = zero, cohY = zero, cohZ = zero;
+  int sepCount = 0, aliCount = 0, cohCount = 0;
+
+  int j = begin;
+  for (; j + 4 <= end; j += 4) {
+    __m128 ox = _mm_loadu_ps(n.px + j), oy = _mm_loadu_ps(n.py + j),
+           oz = _mm_loadu_ps(n.pz + j);
+    __m128 dx = _mm_sub_ps(qx, ox), dy = _mm_sub_ps(qy, oy),
+           dz = _mm_sub_ps(qz, oz);
+    __m128 dist2 = _mm_add_ps(_mm_mul_ps(dx, dx),
+                              _mm_add_ps(_mm_mul_ps(dy, dy), _mm_mul_ps(dz, dz)));
+
+    __m128i index = _mm_add_epi32(_mm_set1_epi32(j), lanes);
+    __m128 isSelf = _mm_castsi128_ps(_mm_cmpeq_epi32(index, selfIndex));
+
+    __m128 sepMask = _mm_andnot_ps(
+        isSelf, _mm_and_ps(_mm_cmplt_ps(dist2, sepR2), _mm_cmpgt_ps(dist2, zero)));
+    __m128 aliMask = _mm_andnot_ps(isSelf, _mm_cmplt_ps(dist2, aliR2));
+    __m128 cohMask = _mm_andnot_ps(isSelf, _mm_cmplt_ps(dist2, cohR2));
+
+    __m128 inv = _mm_and_ps(sepMask, _mm_div_ps(one, dist2));
+    sepX = _mm_add_ps(sepX, _mm_mul_ps(dx, inv));
+    sepY = _mm_add_ps(sepY, _mm_mul_ps(dy, inv));
+    sepZ = _mm_add_ps(sepZ, _mm_mul_ps(dz, inv));
+
+    aliX = _mm_add_ps(aliX, _mm_and_ps(aliMask, _mm_loadu_ps(n.vx + j)));
+    aliY = _mm_add_ps(aliY, _mm_and_ps(aliMask, _mm_loadu_ps(n.vy + j)));
+    aliZ = _mm_add_ps(aliZ, _mm_and_ps(aliMask, _mm_loadu_ps(n.vz + j)));
+
+    cohX = _mm_add_ps(cohX, _mm_and_ps(cohMask, ox));
+    cohY = _mm_add_ps(cohY, _mm_and_ps(cohMask, oy));
+    cohZ = _mm_add_ps(cohZ, _mm_and_ps(cohMask, oz));
+
+    sepCount += __builtin_popcount(_mm_movemask_ps(sepMask));
+    aliCount += __builtin_popcount(_mm_movemask_ps(aliMask));
+    cohCount += __builtin_popcount(_mm_movemask_ps(cohMask));
+  }
+
+  sums.separation += glm::vec3(hsum(sepX), hsum(sepY), hsum(sepZ));
+  sums.alignment += glm::vec3(hsum(aliX), hsum(aliY), hsum(aliZ));
+  sums.cohesion += glm::vec3(hsum(cohX), hsum(cohY), hsum(cohZ));
+  sums.separationCount += sepCount;
+  sums.alignmentCount += aliCount;
+  sums.cohesionCount += cohCount;
+
+  accumulateFlockingScalar(n, j, end, self, pos, sepRadius2, aliRadius2,
+                           cohRadius2, sums);
+}
+
+void integrateBoids(BoidSoA &soa, int begin, int end, float maxSpeed,
+                    const glm::vec3 &boundsMin, const glm::vec3 &boundsMax) {
+  const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+  const __m128 limit = _mm_set1_ps(maxSpeed),
+               limit2 = _mm_set1_ps(maxSpeed * maxSpeed);
+  float *p[3] = {soa.px.data(), soa.py.data(), soa.pz.data()};
+  float *v[3] = {soa.vx.data(), soa.vy.data(), soa.vz.data()};
+  float *a[3] = {soa.ax.data(), soa.ay.data(), soa.az.data()};
+
+  int i = begin;
+  for (; i + 4 <= end; i += 4) {
+    __m128 vel[3];
+    for (int k = 0; k < 3; k++) {
+      vel[k] = _mm_add_ps(_mm_loadu_ps(v[k] + i), _mm_loadu_ps(a[k] + i));
+      _mm_storeu_ps(a[k] + i, zero);
+    }
+    __m128 speed2 = _mm_add_ps(
+        _mm_mul_ps(vel[0], vel[0]),
+        _mm_add_ps(_mm_mul_ps(vel[1], vel[1]), _mm_mul_ps(vel[2], vel[2])));
+    __m128 tooFast = _mm_cmpgt_ps(speed2, limit2);
+    __m128 scale = select(tooFast, _mm_div_ps(limit, _mm_sqrt_ps(speed2)), one);
+    for (int k = 0; k < 3; k++) {
+      __m128 lo = _mm_set1_ps(boundsMin[k]), hi = _mm_set1_ps(boundsMax[k]);
+      vel[k] = _mm_mul_ps(vel[k], scale);
+      _mm_storeu_ps(v[k] + i, vel[k]);
+      __m128 pos = _mm_add_ps(_mm_loadu_ps(p[k] + i), vel[k]);
+      // wrap around to the other side of the box
+      __m128 over = _mm_cmpgt_ps(pos, hi);
+      __m128 under = _mm_cmplt_ps(pos, lo);
+      pos = select(under, hi, pos);
+      pos = select(over, lo, pos);
+      _mm_storeu_ps(p[k] + i, pos);
+    }
+  }
+
+  integrateBoidsScalar(soa, i, end, maxSpeed, boundsMin, boundsMax);
+}
+
+#else
+
+void accumulateFlocking(const NeighborArrays &n, int begin, int end, int self,
+                        const glm::vec3 &pos, float sepRadius2,
+                        float aliRadius2, float cohRadius2,
+                        FlockingSums &sums) {
+  accumulateFlockingScalar(n, begin, end, self, pos, sepRadius2, aliRadius2,
+                           cohRadius2, sums);
+}
+
+void integrateBoids(BoidSoA &soa, int begin, int end, float maxSpeed,
+                    const glm::vec3 &boundsMin, const glm::vec3 &boundsMax) {
+  integrateBoidsScalar(soa, begin, end, maxSpeed, boundsMin, boundsMax);
+}
+
+#endif
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "BoidSoA.hpp"
+#include "ofMain.h"
+
+// Running sums for the fused separation/alignment/cohesion pass.
+struct FlockingSums {
+  glm::vec3 separation = glm::vec3(0, 0, 0); // sum of diff / dist^2
+  glm::vec3 alignment = glm::vec3(0, 0, 0);  // sum of neighbor velocities
+  glm::vec3 cohesion = glm::vec3(0, 0, 0);   // sum of neighbor positions
+  int separationCount = 0;
+  int alignmentCount = 0;
+  int cohesionCount = 0;
+};
+
+// Accumulates neighbors [begin, end) of the arrays into sums. Entry `self` is
+// skipped (pass -1 if the querying boid isn't in the range). Radii are
+// squared. Uses AVX2 / SSE when the compiler targets them.
+void accumulateFlocking(const NeighborArrays &n, int begin, int end, int self,
+                        const glm::vec3 &pos, float sepRadius2,
+                        float aliRadius2, float cohRadius2, FlockingSums &sums);
+
+// Moves boids [begin, end): v += a, clamp |v| to maxSpeed (the flock's, see
+// Boid::KindParams), p += v, wrap around the box and clear a.
+void integrateBoids(BoidSoA &soa, int begin, int end, float maxSpeed,
+                    const glm::vec3 &boundsMin, const glm::vec3 &boundsMax);
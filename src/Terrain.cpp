@@ -0,0 +1,450 @@
+#include "Terrain.hpp"
+
+// part of every cache key, bump it whenever build() or the noise changes what
+// a tile comes out as
+static constexpr int TILE_FORMAT = 1;
+
+// vertex i along edge (bottom, top, left, right) of an n x n grid
+static int edgeVertex(int n, int edge, int i) {
+  switch (edge) {
+  case 0:
+    return i;
+  case 1:
+    return i + (n - 1) * n;
+  case 2:
+    return i * n;
+  default:
+    return (n - 1) + i * n;
+  }
+}
+
+size_t Terrain::TileKeyHash::operator()(const TileKey &key) const {
+  return ((size_t)(uint32_t)key.x * 73856093) ^
+         ((size_t)(uint32_t)key.z * 19349663) ^ ((size_t)key.lod * 83492791);
+}
+
+Terrain::~Terrain() { stop(); }
+
+void Terrain::setup(const Params &params, const Settings &settings) {
+  this->params = params;
+  this->settings = settings;
+  cache.setDirectory(settings.cacheDirectory);
+  cache.trim(settings.cacheBudget);
+
+  // vertex index = col + row * n, then one skirt vertex per edge vertex
+  for (int lod = 0; lod < NUM_LODS; lod++) {
+    int n = (TILE_QUADS >> lod) + 1;
+    vector<glm::vec2> texCoords;
+    vector<ofIndexType> indices;
+    for (int row = 0; row < n; row++) {
+      for (int col = 0; col < n; col++) {
+        texCoords.push_back(glm::vec2(col, row) / (float)(n - 1));
+      }
+    }
+    for (int edge = 0; edge < 4; edge++) {
+      for (int i = 0; i < n; i++) {
+        texCoords.push_back(texCoords[edgeVertex(n, edge, i)]);
+      }
+    }
+    for (int row = 0; row < n - 1; row++) {
+      for (int col = 0; col < n - 1; col++) {
+        indices.push_back(col + row * n);             // 0
+        indices.push_back((col + 1) + row * n);       // 1
+        indices.push_back(col + (row + 1) * n);       // 10
+
+        indices.push_back((col + 1) + row * n);       // 1
+        indices.push_back((col + 1) + (row + 1) * n); // 11
+        indices.push_back(col + (row + 1) * n);       // 10
+      }
+    }
+    for (int edge = 0; edge < 4; edge++) {
+      for (int i = 0; i < n - 1; i++) {
+        int top = edgeVertex(n, edge, i), nextTop = edgeVertex(n, edge, i + 1);
+        int bottom = n * n + edge * n + i;
+        indices.push_back(top);
+        indices.push_back(nextTop);
+        indices.push_back(bottom);
+
+        indices.push_back(nextTop);
+        indices.push_back(bottom + 1);
+        indices.push_back(bottom);
+      }
+    }
+    Topology &t = topology[lod];
+    t.texCoords.allocate(texCoords, GL_STATIC_DRAW);
+    t.indices.allocate(indices, GL_STATIC_DRAW);
+    t.numIndices = indices.size();
+    // counted once here, not per tile
+    residentBytes += texCoords.size() * sizeof(glm::vec2) +
+                     indices.size() * sizeof(ofIndexType);
+  }
+
+  // the tiles under the boids are built here so there is something to
+  // collide with straight away, the rest streams in
+  int x0, x1, z0, z1;
+  collisionRange(x0, x1, z0, z1);
+  for (int z = z0; z <= z1; z++) {
+    for (int x = x0; x <= x1; x++) {
+      TileKey key{x, z, 0};
+      upload(key, build({key, params.noise, generation}));
+    }
+  }
+  rebuildCollision();
+
+  running = true;
+  thread = std::thread([this] { threadedFunction(); });
+}
+
+void Terrain::stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    running = false;
+  }
+  wake.notify_one();
+  if (thread.joinable()) {
+    thread.join();
+  }
+}
+
+void Terrain::setParams(const Params &params) {
+  if (params == this->params) {
+    return;
+  }
+  generation++;
+  this->params = params;
+}
+
+void Terrain::collisionRange(int &x0, int &x1, int &z0, int &z1) const {
+  float tileWorld = TILE_SIZE * settings.scale;
+  x0 = (int)floorf(settings.collisionMin.x / tileWorld);
+  z0 = (int)floorf(settings.collisionMin.y / tileWorld);
+  x1 = std::max((int)ceilf(settings.collisionMax.x / tileWorld) - 1, x0);
+  z1 = std::max((int)ceilf(settings.collisionMax.y / tileWorld) - 1, z0);
+}
+
+Terrain::Tile *Terrain::find(const TileKey &key) {
+  auto it = tiles.find(key);
+  return it == tiles.end() ? nullptr : it->second.get();
+}
+
+Terrain::Tile *Terrain::current(const TileKey &key) {
+  Tile *tile = find(key);
+  return tile && tile->generation == generation ? tile : nullptr;
+}
+
+bool Terrain::update(const glm::vec3 &viewer) {
+  frame++;
+  drawList.clear();
+
+  vector<std::pair<TileKey, std::unique_ptr<Tile>>> done;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    done.swap(finished);
+  }
+  for (auto &[key, tile] : done) {
+    // anything built from noise that changed since is of no use
+    if (tile->generation == generation) {
+      upload(key, std::move(tile));
+    }
+  }
+
+  bool changed = false;
+  if (collisionGeneration != generation) {
+    changed = rebuildCollision();
+  }
+
+  vector<Request> missing;
+  auto need = [&](const TileKey &key) {
+    if (current(key)) {
+      return;
+    }
+    for (auto &request : missing) {
+      if (request.key == key) {
+        return;
+      }
+    }
+    missing.push_back({key, params.noise, generation});
+  };
+
+  // the collision tiles come first and are never evicted
+  int x0, x1, z0, z1;
+  collisionRange(x0, x1, z0, z1);
+  for (int z = z0; z <= z1; z++) {
+    for (int x = x0; x <= x1; x++) {
+      TileKey key{x, z, 0};
+      if (Tile *tile = find(key)) {
+        tile->lastUsed = frame;
+      }
+      need(key);
+    }
+  }
+
+  // then what's in view, nearest first, in the LOD its distance asks for
+  glm::vec2 eye = glm::vec2(viewer.x, viewer.z) / settings.scale;
+  int cx = (int)floorf(eye.x / TILE_SIZE), cz = (int)floorf(eye.y / TILE_SIZE);
+  vector<std::pair<float, TileKey>> wanted;
+  for (int dz = -settings.viewRadius; dz <= settings.viewRadius; dz++) {
+    for (int dx = -settings.viewRadius; dx <= settings.viewRadius; dx++) {
+      TileKey key{cx + dx, cz + dz, 0};
+      glm::vec2 center = (glm::vec2(key.x, key.z) + 0.5f) * TILE_SIZE;
+      float distance = glm::distance(eye, center);
+      key.lod = std::min((int)(distance / settings.lodDistance), NUM_LODS - 1);
+      wanted.push_back({distance, key});
+    }
+  }
+  std::sort(wanted.begin(), wanted.end(),
+            [](const auto &a, const auto &b) { return a.first < b.first; });
+
+  for (auto &[distance, key] : wanted) {
+    need(key);
+    // until the wanted LOD is in, draw the closest one that is, and tiles
+    // from old noise only when there's nothing newer
+    Tile *best = nullptr;
+    for (int pass = 0; pass < 2 && !best; pass++) {
+      for (int d = 0; d < NUM_LODS && !best; d++) {
+        for (int lod : {key.lod - d, key.lod + d}) {
+          Tile *tile = find({key.x, key.z, lod});
+          if (tile && (pass == 1 || tile->generation == generation)) {
+            best = tile;
+            break;
+          }
+        }
+      }
+    }
+    if (best) {
+      best->lastUsed = frame;
+      drawList.push_back(best);
+    }
+  }
+
+  evict();
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    requests.clear();
+    for (auto &request : missing) {
+      bool queued = building.generation == request.generation &&
+                    building.key == request.key;
+      for (auto &[key, tile] : finished) {
+        queued |= key == request.key && tile->generation == request.generation;
+      }
+      if (!queued) {
+        requests.push_back(request);
+      }
+    }
+  }
+  wake.notify_one();
+  return changed;
+}
+
+void Terrain::draw() {
+  for (Tile *tile : drawList) {
+    tile->vbo.drawElements(GL_TRIANGLES, tile->numIndices);
+  }
+}
+
+void Terrain::evict() {
+  vector<std::pair<unsigned long, TileKey>> candidates;
+  for (auto &[key, tile] : tiles) {
+    if (tile->lastUsed == frame) {
+      continue; // drawn this frame or under the boids
+    }
+    if (tile->generation != generation) {
+      // replaced by newer noise and no longer needed as a stand in
+      residentBytes -= tile->bytes;
+      tile.reset();
+      continue;
+    }
+    candidates.push_back({tile->lastUsed, key});
+  }
+  std::erase_if(tiles, [](const auto &entry) { return !entry.second; });
+
+  if (residentBytes <= settings.memoryBudget) {
+    return;
+  }
+  // least recently drawn first
+  std::sort(candidates.begin(), candidates.end(),
+            [](const auto &a, const auto &b) { return a.first < b.first; });
+  for (auto &[lastUsed, key] : candidates) {
+    if (residentBytes <= settings.memoryBudget) {
+      break;
+    }
+    auto it = tiles.find(key);
+    residentBytes -= it->second->bytes;
+    tiles.erase(it);
+  }
+}
+
+void Terrain::upload(const TileKey &key, std::unique_ptr<Tile> tile) {
+  Topology &t = topology[key.lod];
+  int numVertices = tile->vertices.size();
+  tile->vbo.setVertexData(tile->vertices.data(), numVertices, GL_STATIC_DRAW);
+  tile->vbo.setNormalData(tile->normals.data(), numVertices, GL_STATIC_DRAW);
+  tile->vbo.setTexCoordBuffer(t.texCoords, sizeof(glm::vec2));
+  tile->vbo.setIndexBuffer(t.indices);
+  tile->numIndices = t.numIndices;
+  // the vbo has its own copy now
+  tile->vertices = vector<glm::vec3>();
+  tile->normals = vector<glm::vec3>();
+  tile->bytes = numVertices * sizeof(glm::vec3) * 2 +
+                tile->heightField.getHeights().size() * sizeof(float);
+
+  std::unique_ptr<Tile> &slot = tiles[key];
+  if (slot) {
+    residentBytes -= slot->bytes;
+  }
+  residentBytes += tile->bytes;
+  slot = std::move(tile);
+}
+
+uint64_t Terrain::cacheKey(const Request &request) const {
+  const TerrainGenerator::Noise &noise = request.noise;
+  uint64_t h = MeshCache::hash(TILE_FORMAT, MeshCache::FNV_OFFSET);
+  h = MeshCache::hash(request.key, h);
+  h = MeshCache::hash(noise.amplitude, h);
+  h = MeshCache::hash(noise.frequency, h);
+  h = MeshCache::hash(noise.octaves, h);
+  h = MeshCache::hash(noise.offset, h);
+  h = MeshCache::hash(settings.scale, h);
+  h = MeshCache::hash(TILE_SIZE, h);
+  h = MeshCache::hash(TILE_QUADS, h);
+  return MeshCache::hash(SKIRT_DEPTH, h);
+}
+
+std::unique_ptr<Terrain::Tile> Terrain::load(const Request &request,
+                                             uint64_t cacheKey) const {
+  MeshCache::Entry entry;
+  if (!cache.open(std::to_string(cacheKey) + ".tile", cacheKey, entry)) {
+    return nullptr;
+  }
+  int n = (TILE_QUADS >> request.key.lod) + 1;
+  size_t numVertices = n * n + 4 * n;
+  bool heights = request.key.lod == 0;
+  if (entry.vertices().size() != numVertices ||
+      entry.normals().size() != numVertices ||
+      entry.hasHeightField() != heights) {
+    return nullptr;
+  }
+  auto tile = std::make_unique<Tile>();
+  tile->generation = request.generation;
+  tile->vertices.assign(entry.vertices().begin(), entry.vertices().end());
+  tile->normals.assign(entry.normals().begin(), entry.normals().end());
+  if (heights) {
+    entry.copyTo(tile->heightField);
+  }
+  return tile;
+}
+
+std::unique_ptr<Terrain::Tile> Terrain::build(const Request &request) const {
+  uint64_t fileKey = cacheKey(request);
+  if (auto tile = load(request, fileKey)) {
+    return tile;
+  }
+
+  const TileKey &key = request.key;
+  int quads = TILE_QUADS >> key.lod;
+  int n = quads + 1; // samples per side, neighbors share the edge samples
+  float step = TILE_SIZE / quads;
+  glm::vec2 corner = glm::vec2(key.x, key.z) * TILE_SIZE;
+
+  // one extra sample all around so the normals along the edges come out the
+  // same as the neighbor's
+  TerrainGenerator::Grid grid;
+  grid.cols = n + 2;
+  grid.rows = n + 2;
+  grid.step = step;
+  grid.scale = settings.scale;
+  grid.origin = corner - step;
+  TerrainGenerator::Output out;
+  generator.generate(grid, request.noise, out);
+
+  auto tile = std::make_unique<Tile>();
+  tile->generation = request.generation;
+  tile->vertices.resize(n * n + 4 * n);
+  tile->normals.resize(n * n + 4 * n);
+  for (int row = 0; row < n; row++) {
+    for (int col = 0; col < n; col++) {
+      int from = (col + 1) + (row + 1) * (n + 2);
+      tile->vertices[col + row * n] = out.vertices[from];
+      tile->normals[col + row * n] = out.normals[from];
+    }
+  }
+  for (int edge = 0; edge < 4; edge++) {
+    for (int i = 0; i < n; i++) {
+      int from = edgeVertex(n, edge, i);
+      tile->vertices[n * n + edge * n + i] =
+          tile->vertices[from] - glm::vec3(0, SKIRT_DEPTH, 0);
+      tile->normals[n * n + edge * n + i] = tile->normals[from];
+    }
+  }
+
+  if (key.lod == 0) {
+    tile->heightField.setup(n, n, corner * settings.scale,
+                            step * settings.scale);
+    for (int row = 0; row < n; row++) {
+      for (int col = 0; col < n; col++) {
+        tile->heightField.at(col, row) = out.heightField.at(col + 1, row + 1);
+      }
+    }
+  }
+
+  MeshCache::Contents contents;
+  contents.vertices = tile->vertices;
+  contents.normals = tile->normals;
+  if (key.lod == 0) {
+    contents.heightField = &tile->heightField;
+  }
+  cache.save(std::to_string(fileKey) + ".tile", fileKey, contents);
+  return tile;
+}
+
+bool Terrain::rebuildCollision() {
+  int x0, x1, z0, z1;
+  collisionRange(x0, x1, z0, z1);
+  for (int z = z0; z <= z1; z++) {
+    for (int x = x0; x <= x1; x++) {
+      if (!current({x, z, 0})) {
+        return false; // keep the old one until all of them are in
+      }
+    }
+  }
+
+  collision.setup((x1 - x0 + 1) * TILE_QUADS + 1, (z1 - z0 + 1) * TILE_QUADS + 1,
+                  glm::vec2(x0, z0) * TILE_SIZE * settings.scale,
+                  TILE_SIZE / TILE_QUADS * settings.scale);
+  for (int z = z0; z <= z1; z++) {
+    for (int x = x0; x <= x1; x++) {
+      const HeightField &page = find({x, z, 0})->heightField;
+      for (int row = 0; row <= TILE_QUADS; row++) {
+        for (int col = 0; col <= TILE_QUADS; col++) {
+          collision.at((x - x0) * TILE_QUADS + col,
+                       (z - z0) * TILE_QUADS + row) = page.at(col, row);
+        }
+      }
+    }
+  }
+  collisionGeneration = generation;
+  return true;
+}
+
+void Terrain::threadedFunction() {
+  while (true) {
+    Request request;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      wake.wait(lock, [this] { return !requests.empty() || !running; });
+      if (!running) {
+        return;
+      }
+      request = requests.front();
+      requests.pop_front();
+      building = request;
+    }
+    std::unique_ptr<Tile> tile = build(request);
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      finished.emplace_back(request.key, std::move(tile));
+      building = Request{};
+    }
+  }
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+#include "HeightField.hpp"
+#include "MeshCache.hpp"
+#include "TerrainGenerator.hpp"
+#include "ThreadPool.hpp"
+#include "ofMain.h"
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+// The noise terrain, streamed in square tiles around the viewer. Tiles
+// further away use coarser grids, a worker thread generates whatever is
+// missing (nearest first) and the least recently drawn tiles are dropped
+// once they take more than the memory budget, so memory stays flat however
+// far the world goes. The HeightField the boids collide with is put together
+// from the same tiles at full detail, but only over the region the
+// simulation covers.
+class Terrain {
+public:
+  static constexpr float TILE_SIZE = 25; // mesh units per tile side
+  static constexpr int TILE_QUADS = 64;  // quads per tile side at LOD 0
+  static constexpr int NUM_LODS = 4;     // each one halves the quads
+  // how far the skirts hang below a tile's edges, hides the cracks between
+  // tiles of different LODs
+  static constexpr float SKIRT_DEPTH = 1.0f;
+
+  struct Params {
+    TerrainGenerator::Noise noise;
+
+    bool operator==(const Params &) const = default;
+  };
+
+  struct Settings {
+    float scale = 15;       // world units per mesh unit (the mesh is drawn scaled)
+    int viewRadius = 3;     // tiles kept around the viewer in each direction
+    float lodDistance = 30; // mesh units from the viewer per LOD step
+    size_t memoryBudget = 64 << 20; // bytes of tile data kept around
+    // world units getHeightField() has to cover, the boids' box
+    glm::vec2 collisionMin = glm::vec2(-375, -375);
+    glm::vec2 collisionMax = glm::vec2(375, 375);
+    // built tiles are kept here between runs, keyed by the noise, so the
+    // next start maps them instead of generating them. Empty = no disk cache.
+    std::string cacheDirectory;
+    size_t cacheBudget = 256 << 20; // bytes on disk, oldest go first
+  };
+
+  ~Terrain();
+
+  // builds the tiles under the collision region right away and starts the
+  // worker
+  void setup(const Params &params, const Settings &settings);
+  void stop();
+  // new noise regenerates every tile (the old ones are drawn until then)
+  void setParams(const Params &params);
+  // once a frame, viewer in world units: picks up finished tiles, queues the
+  // missing ones and evicts over budget. True if getHeightField() changed.
+  bool update(const glm::vec3 &viewer);
+  // the tiles around the viewer, each in the best detail loaded so far. Mesh
+  // units, draw scaled by the settings' scale.
+  void draw();
+
+  const HeightField &getHeightField() const { return collision; }
+  size_t getResidentBytes() const { return residentBytes; }
+  int getNumTiles() const { return tiles.size(); }
+
+private:
+  struct TileKey {
+    int x, z, lod;
+
+    bool operator==(const TileKey &) const = default;
+  };
+  struct TileKeyHash {
+    size_t operator()(const TileKey &key) const;
+  };
+  struct Tile {
+    vector<glm::vec3> vertices; // grid then skirts, freed once uploaded
+    vector<glm::vec3> normals;
+    HeightField heightField; // world units, only kept at LOD 0
+    ofVbo vbo; // indices and tex coords are bound from its LOD's Topology
+    int numIndices = 0;
+    unsigned long generation = 0; // which params it was built from
+    unsigned long lastUsed = 0;   // frame it was last drawn or pinned
+    size_t bytes = 0;
+  };
+  struct Request {
+    TileKey key;
+    TerrainGenerator::Noise noise;
+    unsigned long generation;
+  };
+  // indices and tex coords are the same for every tile of a LOD, so they are
+  // uploaded once and every tile's vbo reads them from here
+  struct Topology {
+    ofBufferObject indices;
+    ofBufferObject texCoords;
+    int numIndices = 0;
+  };
+
+  void threadedFunction();
+  std::unique_ptr<Tile> build(const Request &request) const;
+  // the tile from the disk cache, null if it isn't there
+  std::unique_ptr<Tile> load(const Request &request, uint64_t cacheKey) const;
+  uint64_t cacheKey(const Request &request) const;
+  void upload(const TileKey &key, std::unique_ptr<Tile> tile);
+  Tile *find(const TileKey &key);
+  Tile *current(const TileKey &key); // only if built from the newest params
+  void evict();
+  // tiles under the collision region, inclusive
+  void collisionRange(int &x0, int &x1, int &z0, int &z1) const;
+  bool rebuildCollision();
+
+  Settings settings;
+  Params params;
+  unsigned long generation = 1; // bumped whenever the noise changes
+  unsigned long frame = 0;
+  Topology topology[NUM_LODS];
+  MeshCache cache;
+
+  std::unordered_map<TileKey, std::unique_ptr<Tile>, TileKeyHash> tiles;
+  size_t residentBytes = 0;
+  vector<Tile *> drawList; // picked in update(), drawn in draw()
+  HeightField collision;
+  unsigned long collisionGeneration = 0;
+
+  // a pool of its own, so building a tile never waits on (or stalls) the
+  // simulation's parallelFor calls on ThreadPool::shared()
+  ThreadPool pool;
+  TerrainGenerator generator{pool};
+
+  std::thread thread;
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::deque<Request> requests; // guarded by mutex, nearest first
+  vector<std::pair<TileKey, std::unique_ptr<Tile>>>
+      finished;                 // guarded by mutex
+  Request building{};           // guarded by mutex, generation 0 = idle
+  bool running = false;         // guarded by mutex
+};
@@ -0,0 +1,252 @@
+#include "TerrainGenerator.hpp"
+
+#if defined(__AVX2__) && defined(__FMA__)
+#include <immintrin.h>
+#endif
+
+// Simplex noise as in openFrameworks' ofNoise (Stefan Gustavson's
+// implementation), with a real floor and & 255 so negative coordinates work
+// too.
+
+static constexpr float F2 = 0.366025403f; // 0.5 * (sqrt(3) - 1)
+static constexpr float G2 = 0.211324865f; // (3 - sqrt(3)) / 6
+
+static constexpr unsigned char permutation[256] = {
+    151, 160, 137, 91,  90,  15,  131, 13,  201, 95,  96,  53,  194, 233, 7,
+    225, 140, 36,  103, 30,  69,  142, 8,   99,  37,  240, 21,  10,  23,  190,
+    6,   148, 247, 120, 234, 75,  0,   26,  197, 62,  94,  252, 219, 203, 117,
+    35,  11,  32,  57,  177, 33,  88,  237, 149, 56,  87,  174, 20,  125, 136,
+    171, 168, 68,  175, 74,  165, 71,  134, 139, 48,  27,  166, 77,  146, 158,
+    231, 83,  111, 229, 122, 60,  211, 133, 230, 220, 105, 92,  41,  55,  46,
+    245, 40,  244, 102, 143, 54,  65,  25,  63,  161, 1,   216, 80,  73,  209,
+    76,  132, 187, 208, 89,  18,  169, 200, 196, 135, 130, 116, 188, 159, 86,
+    164, 100, 109, 198, 173, 186, 3,   64,  52,  217, 226, 250, 124, 123, 5,
+    202, 38,  147, 118, 126, 255, 82,  85,  212, 207, 206, 59,  227, 47,  16,
+    58,  17,  182, 189, 28,  42,  223, 183, 170, 213, 119, 248, 152, 2,   44,
+    154, 163, 70,  221, 153, 101, 155, 167, 43,  172, 9,   129, 22,  39,  253,
+    19,  98,  108, 110, 79,  113, 224, 232, 178, 185, 112, 104, 218, 246, 97,
+    228, 251, 34,  242, 193, 238, 210, 144, 12,  191, 179, 162, 241, 81,  51,
+    145, 235, 249, 14,  239, 107, 49,  192, 214, 31,  181, 199, 106, 157, 184,
+    84,  204, 176, 115, 121, 50,  45,  127, 4,   150, 254, 138, 236, 205, 93,
+    222, 114, 67,  29,  24,  72,  243, 141, 128, 195, 78,  66,  215, 61,  156,
+    180};
+
+// the permutation twice over, as ints so AVX2 can gather from it
+struct PermTable {
+  int p[512];
+  constexpr PermTable() : p() {
+    for (int i = 0; i < 512; i++) {
+      p[i] = permutation[i & 255];
+    }
+  }
+};
+static constexpr PermTable perm;
+
+static float grad2(int hash, float x, float y) {
+  int h = hash & 7;     // low 3 bits pick one of 8 gradient directions
+  float u = h < 4 ? x : y;
+  float v = h < 4 ? y : x;
+  return ((h & 1) ? -u : u) + ((h & 2) ? -2.0f * v : 2.0f * v);
+}
+
+static float corner(int hash, float x, float y) {
+  float t = 0.5f - x * x - y * y;
+  if (t < 0.0f) {
+    return 0.0f;
+  }
+  t *= t;
+  return t * t * grad2(hash, x, y);
+}
+
+float TerrainGenerator::noise(float x, float y) {
+  // skew into simplex space to find the cell, then unskew back
+  float s = (x + y) * F2;
+  int i = (int)floorf(x + s);
+  int j = (int)floorf(y + s);
+  float t = (i + j) * G2;
+  float x0 = x - (i - t);
+  float y0 = y - (j - t);
+  // lower or upper triangle of the cell
+  int i1 = x0 > y0 ? 1 : 0;
+  int j1 = 1 - i1;
+  float x1 = x0 - i1 + G2, y1 = y0 - j1 + G2;
+  float x2 = x0 - 1.0f + 2.0f * G2, y2 = y0 - 1.0f + 2.0f * G2;
+  int ii = i & 255, jj = j & 255;
+  float n = corner(perm.p[ii + perm.p[jj]], x0, y0) +
+            corner(perm.p[ii + i1 + perm.p[jj + j1]], x1, y1) +
+            corner(perm.p[ii + 1 + perm.p[jj + 1]], x2, y2);
+  return 40.0f * n * 0.5f + 0.5f;
+}
+
+// height at noise position (x, y)
+static float fbm(const TerrainGenerator::Noise &noise, float x, float y) {
+  float amplitude = noise.amplitude, frequency = noise.frequency;
+  float raw = 0;
+  for (int o = 0; o < (int)noise.octaves; o++) {
+    raw += TerrainGenerator::noise(x * frequency, y * frequency) * amplitude;
+    amplitude *= 0.5;
+    frequency *= 1.5;
+  }
+  return (raw - noise.octaves) * 2.0f * noise.amplitude; // center and scale
+}
+
+float TerrainGenerator::height(const Noise &noise, float x, float z) {
+  return fbm(noise, x + noise.offset.x, z + noise.offset.y);
+}
+
+// heights of samples [begin, end) of the row at noise position y, sample 0
+// is at noise position x0
+static void heightsScalar(const TerrainGenerator::Noise &noise, float x0,
+                          float step, float y, int begin, int end,
+                          float *out) {
+  for (int col = begin; col < end; col++) {
+    out[col] = fbm(noise, x0 + col * step, y);
+  }
+}
+
+#if defined(__AVX2__) && defined(__FMA__)
+
+static __m256 grad2(__m256i hash, __m256 x, __m256 y) {
+  const __m256 signBit = _mm256_set1_ps(-0.0f);
+  __m256i h = _mm256_and_si256(hash, _mm256_set1_epi32(7));
+  __m256 low = _mm256_castsi256_ps(
+      _mm256_cmpgt_epi32(_mm256_set1_epi32(4), h)); // h < 4
+  __m256 u = _mm256_blendv_ps(y, x, low);
+  __m256 v = _mm256_blendv_ps(x, y, low);
+  // bit 0 flips u, bit 1 flips v, moved up into the float sign bit
+  __m256 flipU = _mm256_castsi256_ps(_mm256_slli_epi32(h, 31));
+  __m256 flipV = _mm256_castsi256_ps(
+      _mm256_slli_epi32(_mm256_srli_epi32(h, 1), 31));
+  u = _mm256_xor_ps(u, _mm256_and_ps(flipU, signBit));
+  v = _mm256_xor_ps(v, _mm256_and_ps(flipV, signBit));
+  return _mm256_fmadd_ps(_mm256_set1_ps(2.0f), v, u);
+}
+
+static __m256 corner(__m256i hash, __m256 x, __m256 y) {
+  __m256 t = _mm256_sub_ps(
+      _mm256_set1_ps(0.5f),
+      _mm256_fmadd_ps(x, x, _mm256_mul_ps(y, y)));
+  __m256 inside = _mm256_cmp_ps(t, _mm256_setzero_ps(), _CMP_GE_OQ);
+  t = _mm256_mul_ps(t, t);
+  t = _mm256_mul_ps(t, t);
+  return _mm256_and_ps(inside, _mm256_mul_ps(t, grad2(hash, x, y)));
+}
+
+static __m256i lookup(__m256i index) {
+  return _mm256_i32gather_epi32(perm.p, index, 4);
+}
+
+// TerrainGenerator::noise for 8 points
+static __m256 noise8(__m256 x, __m256 y) {
+  const __m256 g2 = _mm256_set1_ps(G2);
+  const __m256i one = _mm256_set1_epi32(1), mask = _mm256_set1_epi32(255);
+  __m256 s = _mm256_mul_ps(_mm256_add_ps(x, y), _mm256_set1_ps(F2));
+  __m256 fi = _mm256_floor_ps(_mm256_add_ps(x, s));
+  __m256 fj = _mm256_floor_ps(_mm256_add_ps(y, s));
+  __m256 t = _mm256_mul_ps(_mm256_add_ps(fi, fj), g2);
+  __m256 x0 = _mm256_sub_ps(x, _mm256_sub_ps(fi, t));
+  __m256 y0 = _mm256_sub_ps(y, _mm256_sub_ps(fj, t));
+
+  __m256 lower = _mm256_cmp_ps(x0, y0, _CMP_GT_OQ);
+  __m256 fi1 = _mm256_and_ps(lower, _mm256_set1_ps(1.0f));
+  __m256 fj1 = _mm256_andnot_ps(lower, _mm256_set1_ps(1.0f));
+  __m256 x1 = _mm256_add_ps(_mm256_sub_ps(x0, fi1), g2);
+  __m256 y1 = _mm256_add_ps(_mm256_sub_ps(y0, fj1), g2);
+  __m256 x2 = _mm256_add_ps(x0, _mm256_set1_ps(2.0f * G2 - 1.0f));
+  __m256 y2 = _mm256_add_ps(y0, _mm256_set1_ps(2.0f * G2 - 1.0f));
+
+  __m256i ii = _mm256_and_si256(_mm256_cvtps_epi32(fi), mask);
+  __m256i jj = _mm256_and_si256(_mm256_cvtps_epi32(fj), mask);
+  __m256i i1 = _mm256_cvtps_epi32(fi1), j1 = _mm256_cvtps_epi32(fj1);
+  __m256i h0 = lookup(_mm256_add_epi32(ii, lookup(jj)));
+  __m256i h1 = lookup(_mm256_add_epi32(_mm256_add_epi32(ii, i1),
+                                       lookup(_mm256_add_epi32(jj, j1))));
+  __m256i h2 = lookup(_mm256_add_epi32(_mm256_add_epi32(ii, one),
+                                       lookup(_mm256_add_epi32(jj, one))));
+
+  __m256 n = _mm256_add_ps(corner(h0, x0, y0),
+                           _mm256_add_ps(corner(h1, x1, y1),
+                                         corner(h2, x2, y2)));
+  return _mm256_fmadd_ps(n, _mm256_set1_ps(20.0f), _mm256_set1_ps(0.5f));
+}
+
+// heightsScalar, 8 samples at a time
+static void heights(const TerrainGenerator::Noise &noise, float x0,
+                    float step, float y, int begin, int end, float *out) {
+  const __m256 lanes = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+  const __m256 start = _mm256_set1_ps(x0);
+  const __m256 stepLanes = _mm256_set1_ps(step);
+  int octaves = (int)noise.octaves;
+  int col = begin;
+  for (; col + 8 <= end; col += 8) {
+    __m256 x = _mm256_fmadd_ps(
+        _mm256_add_ps(_mm256_set1_ps((float)col), lanes), stepLanes, start);
+    float amplitude = noise.amplitude, frequency = noise.frequency;
+    __m256 raw = _mm256_setzero_ps();
+    for (int o = 0; o < octaves; o++) {
+      __m256 f = _mm256_set1_ps(frequency);
+      raw = _mm256_fmadd_ps(noise8(_mm256_mul_ps(x, f),
+                                   _mm256_set1_ps(y * frequency)),
+                            _mm256_set1_ps(amplitude), raw);
+      amplitude *= 0.5;
+      frequency *= 1.5;
+    }
+    __m256 height = _mm256_mul_ps(
+        _mm256_sub_ps(raw, _mm256_set1_ps(noise.octaves)),
+        _mm256_set1_ps(2.0f * noise.amplitude));
+    _mm256_storeu_ps(out + col, height);
+  }
+  heightsScalar(noise, x0, step, y, col, end, out);
+}
+
+#else
+
+static void heights(const TerrainGenerator::Noise &noise, float x0,
+                    float step, float y, int begin, int end, float *out) {
+  heightsScalar(noise, x0, step, y, begin, end, out);
+}
+
+#endif
+
+void TerrainGenerator::generate(const Grid &grid, const Noise &noise,
+                                Output &out) const {
+  int cols = grid.cols, rows = grid.rows;
+  float step = grid.step;
+  glm::vec2 noiseOrigin = grid.origin + noise.offset;
+  out.vertices.resize(cols * rows);
+  out.normals.resize(cols * rows);
+  out.heightField.setup(cols, rows, grid.origin * grid.scale,
+                        step * grid.scale);
+
+  pool.parallelFor(rows, 8, [&](int begin, int end) {
+    for (int row = begin; row < end; row++) {
+      float z = grid.origin.y + row * step;
+      // the height field's row doubles as the scratch row for the noise
+      float *h = &out.heightField.at(0, row);
+      heights(noise, noiseOrigin.x, step, noiseOrigin.y + row * step, 0, cols,
+              h);
+      glm::vec3 *v = out.vertices.data() + row * cols;
+      for (int col = 0; col < cols; col++) {
+        v[col] = glm::vec3(grid.origin.x + col * step, h[col], z);
+        h[col] *= grid.scale;
+      }
+    }
+  });
+
+  // per vertex normals from the neighboring heights (one sided at the edges)
+  pool.parallelFor(rows, 8, [&](int begin, int end) {
+    for (int row = begin; row < end; row++) {
+      int up = std::max(row - 1, 0), down = std::min(row + 1, rows - 1);
+      for (int col = 0; col < cols; col++) {
+        int left = std::max(col - 1, 0), right = std::min(col + 1, cols - 1);
+        float dx = out.vertices[right + row * cols].y -
+                   out.vertices[left + row * cols].y;
+        float dz = out.vertices[col + down * cols].y -
+                   out.vertices[col + up * cols].y;
+        out.normals[col + row * cols] = glm::normalize(
+            glm::vec3(-dx / std::max((right - left) * step, step), 1.0f,
+                      -dz / std::max((down - up) * step, step)));
+      }
+    }
+  });
+}
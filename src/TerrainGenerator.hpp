@@ -0,0 +1,55 @@
+#pragma once
+
+#include "HeightField.hpp"
+#include "ThreadPool.hpp"
+#include "ofMain.h"
+
+// Fractal (fBm) noise terrain on a regular grid. Rows are spread over a
+// thread pool and each row is evaluated 8 samples at a time with AVX2, so big
+// grids (2048 x 2048 and up) stay cheap enough to rebuild from a slider.
+class TerrainGenerator {
+public:
+  // layout of the grid in mesh units, the default one is the 50 x 50 terrain
+  // centered on the origin
+  struct Grid {
+    int cols = 100;   // samples along x
+    int rows = 100;   // samples along z
+    float step = 0.5; // mesh units between samples
+    float scale = 1;  // world units per mesh unit (the mesh is drawn scaled)
+    glm::vec2 origin = glm::vec2(-25, -25); // position of sample (0, 0)
+
+    bool operator==(const Grid &) const = default;
+  };
+
+  struct Noise {
+    float amplitude = 2.5;
+    float frequency = 0.1;
+    float octaves = 1; // the slider is a float, only whole octaves are summed
+    // where mesh position (0, 0) looks up the noise, keeps the noise's own
+    // origin in the corner of the default grid
+    glm::vec2 offset = glm::vec2(25, 25);
+
+    bool operator==(const Noise &) const = default;
+  };
+
+  struct Output {
+    vector<glm::vec3> vertices; // mesh units, index = col + row * cols
+    vector<glm::vec3> normals;  // one per vertex
+    HeightField heightField;    // world units
+  };
+
+  explicit TerrainGenerator(ThreadPool &pool = ThreadPool::shared())
+      : pool(pool) {}
+
+  // vertices, normals and heightField from a single noise evaluation per
+  // sample, out's buffers are reused when the grid size stays the same
+  void generate(const Grid &grid, const Noise &noise, Output &out) const;
+
+  // same as ofNoise(x, y): 2d simplex noise mapped to [0, 1]
+  static float noise(float x, float y);
+  // terrain height in mesh units at mesh position (x, z)
+  static float height(const Noise &noise, float x, float z);
+
+private:
+  ThreadPool &pool;
+};
@@ -0,0 +1,101 @@
+#include "ThreadPool.hpp"
+#include <algorithm>
+
+ThreadPool::ThreadPool(int numThreads) {
+  numThreads = std::max(numThreads, 1);
+  ranges = std::make_unique<ChunkRange[]>(numThreads);
+  for (int i = 0; i < numThreads - 1; i++) {
+    workers.emplace_back([this, i] { workerLoop(i); });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  wake.notify_all();
+  for (auto &worker : workers) {
+    worker.join();
+  }
+}
+
+ThreadPool &ThreadPool::shared() {
+  static ThreadPool pool;
+  return pool;
+}
+
+void ThreadPool::parallelFor(int count, int chunkSize,
+                             const std::function<void(int, int)> &fn) {
+  if (count <= 0) {
+    return;
+  }
+  chunkSize = std::max(chunkSize, 1);
+  int numChunks = (count + chunkSize - 1) / chunkSize;
+  if (workers.empty() || numChunks == 1) {
+    for (int begin = 0; begin < count; begin += chunkSize) {
+      fn(begin, std::min(begin + chunkSize, count));
+    }
+    return;
+  }
+
+  std::lock_guard<std::mutex> run(runMutex);
+  int participants = size();
+  for (int p = 0; p < participants; p++) {
+    ranges[p].next.store(numChunks * p / participants, std::memory_order_relaxed);
+    ranges[p].end = numChunks * (p + 1) / participants;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    job = &fn;
+    jobCount = count;
+    jobChunkSize = chunkSize;
+    busyWorkers = (int)workers.size();
+    generation++;
+  }
+  wake.notify_all();
+
+  // the caller takes the last share
+  runChunks(participants - 1);
+
+  std::unique_lock<std::mutex> lock(mutex);
+  done.wait(lock, [this] { return busyWorkers == 0; });
+  job = nullptr;
+}
+
+void ThreadPool::workerLoop(int id) {
+  unsigned long seen = 0;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      wake.wait(lock, [&] { return stopping || generation != seen; });
+      if (stopping) {
+        return;
+      }
+      seen = generation;
+    }
+    runChunks(id);
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (--busyWorkers == 0) {
+        done.notify_one();
+      }
+    }
+  }
+}
+
+void ThreadPool::runChunks(int self) {
+  int participants = size();
+  // own share first, then steal from the others
+  for (int k = 0; k < participants; k++) {
+    ChunkRange &range = ranges[(self + k) % participants];
+    while (true) {
+      int chunk = range.next.fetch_add(1, std::memory_order_relaxed);
+      if (chunk >= range.end) {
+        break;
+      }
+      int begin = chunk * jobChunkSize;
+      (*job)(begin, std::min(begin + jobChunkSize, jobCount));
+    }
+  }
+}
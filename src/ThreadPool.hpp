@@ -0,0 +1,55 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Small fork-join pool for data-parallel loops. parallelFor splits [0, count)
+// into chunks, deals each participant (the workers plus the calling thread)
+// its own contiguous share of the chunks, and lets whoever runs out first
+// steal the remaining chunks of the others.
+class ThreadPool {
+public:
+  // numThreads counts the calling thread, so 1 means everything runs inline
+  explicit ThreadPool(int numThreads = std::thread::hardware_concurrency());
+  ~ThreadPool();
+
+  // Calls fn(begin, end) for every chunk and returns once all of them ran.
+  // Chunk boundaries only depend on count and chunkSize, not on the number of
+  // threads.
+  void parallelFor(int count, int chunkSize,
+                   const std::function<void(int, int)> &fn);
+
+  int size() const { return (int)workers.size() + 1; }
+
+  // pool shared by the simulation code
+  static ThreadPool &shared();
+
+private:
+  struct alignas(64) ChunkRange {
+    std::atomic<int> next{0};
+    int end = 0;
+  };
+
+  void workerLoop(int id);
+  void runChunks(int self);
+
+  std::vector<std::thread> workers;
+  std::unique_ptr<ChunkRange[]> ranges; // one per participant
+
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::condition_variable done;
+  std::mutex runMutex; // one parallelFor at a time
+
+  const std::function<void(int, int)> *job = nullptr;
+  int jobCount = 0;
+  int jobChunkSize = 1;
+  unsigned long generation = 0;
+  int busyWorkers = 0;
+  bool stopping = false;
+};
@@ -0,0 +1,406 @@
+#include "TriangleBVH.hpp"
+#include <limits>
+
+TriangleMesh TriangleMesh::fromHeightField(const HeightField &heightField) {
+  TriangleMesh mesh;
+  int cols = heightField.getCols(), rows = heightField.getRows();
+  if (cols < 2 || rows < 2) {
+    return mesh;
+  }
+  glm::vec2 origin = heightField.getOrigin();
+  float spacing = heightField.getSpacing();
+  mesh.vertices.reserve(cols * rows);
+  for (int row = 0; row < rows; row++) {
+    for (int col = 0; col < cols; col++) {
+      mesh.vertices.push_back(glm::vec3(origin.x + col * spacing,
+                                        heightField.at(col, row),
+                                        origin.y + row * spacing));
+    }
+  }
+  mesh.indices.reserve((cols - 1) * (rows - 1) * 6);
+  for (int row = 0; row < rows - 1; row++) {
+    for (int col = 0; col < cols - 1; col++) {
+      uint32_t corner = row * cols + col;
+      mesh.indices.insert(mesh.indices.end(),
+                          {corner, corner + 1, corner + cols, corner + 1,
+                           corner + cols + 1, corner + cols});
+    }
+  }
+  return mesh;
+}
+
+struct TriangleBVH::BuildRef {
+  glm::vec3 boundsMin, boundsMax, centroid;
+  uint32_t index;
+};
+
+// past this depth nodes split in the middle, which keeps the tree (and the
+// traversal stack) shallow whatever the SAH makes of degenerate input
+static constexpr int MAX_SAH_DEPTH = 48;
+static constexpr int STACK_SIZE = 96;
+
+// half the surface area, only ever compared
+static float halfArea(const glm::vec3 &lo, const glm::vec3 &hi) {
+  glm::vec3 d = glm::max(hi - lo, glm::vec3(0, 0, 0));
+  return d.x * d.y + d.y * d.z + d.z * d.x;
+}
+
+void TriangleBVH::clear() {
+  nodes.clear();
+  triangles.clear();
+  original.clear();
+}
+
+void TriangleBVH::build(const TriangleMesh &mesh) {
+  build(mesh.vertices, mesh.indices);
+}
+
+void TriangleBVH::build(std::span<const glm::vec3> vertices,
+                        std::span<const uint32_t> indices) {
+  clear();
+  vector<BuildRef> refs;
+  refs.reserve(indices.size() / 3);
+  for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+    if (indices[i] >= vertices.size() || indices[i + 1] >= vertices.size() ||
+        indices[i + 2] >= vertices.size()) {
+      continue; // a broken mesh, skip what doesn't exist
+    }
+    const glm::vec3 &a = vertices[indices[i]], &b = vertices[indices[i + 1]],
+                    &c = vertices[indices[i + 2]];
+    BuildRef ref;
+    ref.boundsMin = glm::min(a, glm::min(b, c));
+    ref.boundsMax = glm::max(a, glm::max(b, c));
+    ref.centroid = (a + b + c) / 3.0f;
+    ref.index = i / 3;
+    refs.push_back(ref);
+  }
+  if (refs.empty()) {
+    return;
+  }
+  // a binary tree with leaves of at least one triangle stays under 2n nodes
+  nodes.reserve(refs.size() * 2);
+  triangles.reserve(refs.size());
+  original.reserve(refs.size());
+  buildNode(refs, 0, refs.size(), 0, vertices, indices);
+}
+
+uint32_t TriangleBVH::buildNode(vector<BuildRef> &refs, int begin, int end,
+                                int depth, std::span<const glm::vec3> vertices,
+                                std::span<const uint32_t> indices) {
+  uint32_t index = nodes.size();
+  nodes.push_back(Node());
+  glm::vec3 lo = refs[begin].boundsMin, hi = refs[begin].boundsMax;
+  glm::vec3 centroidLo = refs[begin].centroid, centroidHi = centroidLo;
+  for (int i = begin + 1; i < end; i++) {
+    lo = glm::min(lo, refs[i].boundsMin);
+    hi = glm::max(hi, refs[i].boundsMax);
+    centroidLo = glm::min(centroidLo, refs[i].centroid);
+    centroidHi = glm::max(centroidHi, refs[i].centroid);
+  }
+  nodes[index].boundsMin = lo;
+  nodes[index].boundsMax = hi;
+
+  int count = end - begin;
+  if (count <= MAX_LEAF) {
+    nodes[index].first = triangles.size();
+    nodes[index].count = count;
+    for (int i = begin; i < end; i++) {
+      uint32_t t = refs[i].index;
+      const glm::vec3 &a = vertices[indices[t * 3]];
+      const glm::vec3 &b = vertices[indices[t * 3 + 1]];
+      const glm::vec3 &c = vertices[indices[t * 3 + 2]];
+      triangles.push_back({a, b, c});
+      original.push_back(t);
+    }
+    return index;
+  }
+
+  // binned SAH: for every axis, the triangles go in SAH_BINS bins by
+  // centroid, and the best of the SAH_BINS - 1 planes between bins wins
+  int bestAxis = -1, bestPlane = 0;
+  float bestCost = std::numeric_limits<float>::max();
+  if (depth < MAX_SAH_DEPTH) {
+    for (int axis = 0; axis < 3; axis++) {
+      float extent = centroidHi[axis] - centroidLo[axis];
+      if (extent <= 0) {
+        continue;
+      }
+      float toBin = SAH_BINS / extent;
+      int binCount[SAH_BINS] = {};
+      glm::vec3 binLo[SAH_BINS], binHi[SAH_BINS];
+      for (int i = begin; i < end; i++) {
+        int bin = std::min((int)((refs[i].centroid[axis] - centroidLo[axis]) *
+                                 toBin),
+                           SAH_BINS - 1);
+        binLo[bin] = binCount[bin] ? glm::min(binLo[bin], refs[i].boundsMin)
+                                   : refs[i].boundsMin;
+        binHi[bin] = binCount[bin] ? glm::max(binHi[bin], refs[i].boundsMax)
+                                   : refs[i].boundsMax;
+        binCount[bin]++;
+      }
+      // sweep from the right, then from the left, plane p splits bins
+      // [0, p] from [p + 1, SAH_BINS)
+      float rightCost[SAH_BINS];
+      glm::vec3 sweepLo, sweepHi;
+      int n = 0;
+      for (int b = SAH_BINS - 1; b > 0; b--) {
+        if (binCount[b]) {
+          sweepLo = n ? glm::min(sweepLo, binLo[b]) : binLo[b];
+          sweepHi = n ? glm::max(sweepHi, binHi[b]) : binHi[b];
+          n += binCount[b];
+        }
+        rightCost[b - 1] = n ? halfArea(sweepLo, sweepHi) * n : 0;
+      }
+      n = 0;
+      for (int p = 0; p < SAH_BINS - 1; p++) {
+        if (binCount[p]) {
+          sweepLo = n ? glm::min(sweepLo, binLo[p]) : binLo[p];
+          sweepHi = n ? glm::max(sweepHi, binHi[p]) : binHi[p];
+          n += binCount[p];
+        }
+        if (n == 0 || n == count) {
+          continue; // one side empty, not a split
+        }
+        float cost = halfArea(sweepLo, sweepHi) * n + rightCost[p];
+        if (cost < bestCost) {
+          bestCost = cost;
+          bestAxis = axis;
+          bestPlane = p;
+        }
+      }
+    }
+  }
+
+  int middle = begin + count / 2;
+  if (bestAxis >= 0) {
+    float toBin = SAH_BINS / (centroidHi[bestAxis] - centroidLo[bestAxis]);
+    float axisLo = centroidLo[bestAxis];
+    middle = std::partition(refs.begin() + begin, refs.begin() + end,
+                            [&](const BuildRef &ref) {
+                              int bin = std::min(
+                                  (int)((ref.centroid[bestAxis] - axisLo) *
+                                        toBin),
+                                  SAH_BINS - 1);
+                              return bin <= bestPlane;
+                            }) -
+             refs.begin();
+  } else {
+    // nothing to tell the triangles apart by (or too deep), halve them along
+    // the longest side
+    glm::vec3 extent = centroidHi - centroidLo;
+    int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2)
+                                   : (extent.y > extent.z ? 1 : 2);
+    std::nth_element(refs.begin() + begin, refs.begin() + middle,
+                     refs.begin() + end,
+                     [&](const BuildRef &a, const BuildRef &b) {
+                       return a.centroid[axis] < b.centroid[axis];
+                     });
+  }
+
+  // the left child is always index + 1
+  buildNode(refs, begin, middle, depth + 1, vertices, indices);
+  uint32_t right = buildNode(refs, middle, end, depth + 1, vertices, indices);
+  nodes[index].first = right;
+  nodes[index].count = 0;
+  return index;
+}
+
+// closest point to p on the triangle, Ericson's Real-Time Collision
+// Detection 5.1.5, by the Voronoi region p falls in
+static glm::vec3 closestOnTriangle(const glm::vec3 &p, const glm::vec3 &a,
+                                   const glm::vec3 &ab, const glm::vec3 &ac) {
+  glm::vec3 ap = p - a;
+  float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+  if (d1 <= 0 && d2 <= 0) {
+    return a;
+  }
+  glm::vec3 bp = ap - ab;
+  float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+  if (d3 >= 0 && d4 <= d3) {
+    return a + ab;
+  }
+  float vc = d1 * d4 - d3 * d2;
+  if (vc <= 0 && d1 >= 0 && d3 <= 0) {
+    return a + ab * (d1 / (d1 - d3));
+  }
+  glm::vec3 cp = ap - ac;
+  float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+  if (d6 >= 0 && d5 <= d6) {
+    return a + ac;
+  }
+  float vb = d5 * d2 - d1 * d6;
+  if (vb <= 0 && d2 >= 0 && d6 <= 0) {
+    return a + ac * (d2 / (d2 - d6));
+  }
+  float va = d3 * d6 - d5 * d4;
+  if (va <= 0 && (d4 - d3) >= 0 && (d5 - d6) >= 0) {
+    return a + ab + (ac - ab) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+  }
+  float denom = 1.0f / (va + vb + vc);
+  return a + ab * (vb * denom) + ac * (vc * denom);
+}
+
+// squared distance from p to the box, 0 inside it
+static float distance2(const glm::vec3 &p, const glm::vec3 &lo,
+                       const glm::vec3 &hi) {
+  glm::vec3 d = glm::max(glm::max(lo - p, p - hi), glm::vec3(0, 0, 0));
+  return glm::dot(d, d);
+}
+
+bool TriangleBVH::nearest(const glm::vec3 &point, float maxDistance,
+                          Hit &hit) const {
+  hit.triangle = NONE;
+  if (nodes.empty()) {
+    return false;
+  }
+  float best2 = maxDistance * maxDistance;
+  uint32_t best = NONE;
+  glm::vec3 bestPoint;
+  uint32_t stack[STACK_SIZE];
+  float stackD2[STACK_SIZE];
+  int size = 0;
+  uint32_t current = 0;
+  if (distance2(point, nodes[0].boundsMin, nodes[0].boundsMax) > best2) {
+    return false;
+  }
+  while (true) {
+    const Node &node = nodes[current];
+    if (node.count > 0) {
+      for (uint32_t i = node.first; i < node.first + node.count; i++) {
+        const Triangle &tri = triangles[i];
+        glm::vec3 closest =
+            closestOnTriangle(point, tri.a, tri.b - tri.a, tri.c - tri.a);
+        glm::vec3 d = point - closest;
+        float d2 = glm::dot(d, d);
+        if (d2 <= best2) {
+          best2 = d2;
+          best = i;
+          bestPoint = closest;
+        }
+      }
+    } else {
+      // nearer box first, same as traverse()
+      uint32_t left = current + 1, right = node.first;
+      float dLeft =
+          distance2(point, nodes[left].boundsMin, nodes[left].boundsMax);
+      float dRight =
+          distance2(point, nodes[right].boundsMin, nodes[right].boundsMax);
+      if (dRight < dLeft) {
+        std::swap(left, right);
+        std::swap(dLeft, dRight);
+      }
+      if (dLeft <= best2) {
+        if (dRight <= best2) {
+          stack[size] = right;
+          stackD2[size++] = dRight;
+        }
+        current = left;
+        continue;
+      }
+    }
+    do {
+      if (size == 0) {
+        if (best == NONE) {
+          return false;
+        }
+        const Triangle &tri = triangles[best];
+        float distance = sqrtf(best2);
+        hit.t = distance;
+        hit.point = bestPoint;
+        hit.normal = distance > 0
+                         ? (point - bestPoint) / distance
+                         : glm::normalize(
+                               glm::cross(tri.b - tri.a, tri.c - tri.a));
+        hit.triangle = original[best];
+        return true;
+      }
+      current = stack[--size];
+    } while (stackD2[size] > best2);
+  }
+}
+
+// which side of the line from p to q point is on (x, z only), twice the
+// signed area of the three. Always worked out from the same end of the line,
+// so the two triangles sharing an edge get exactly opposite values
+static double side(const glm::vec3 &p, const glm::vec3 &q,
+                   const glm::vec3 &point) {
+  if (q.x < p.x || (q.x == p.x && q.z < p.z)) {
+    return -side(q, p, point);
+  }
+  return ((double)q.x - p.x) * ((double)point.z - p.z) -
+         ((double)q.z - p.z) * ((double)point.x - p.x);
+}
+
+template <class Visit>
+void TriangleBVH::traverseUp(const glm::vec3 &point, Visit &&visit) const {
+  auto reaches = [&](const Node &node) {
+    return point.x >= node.boundsMin.x && point.x <= node.boundsMax.x &&
+           point.z >= node.boundsMin.z && point.z <= node.boundsMax.z &&
+           point.y < node.boundsMax.y;
+  };
+  if (nodes.empty() || !reaches(nodes[0])) {
+    return;
+  }
+  uint32_t stack[STACK_SIZE];
+  int size = 0;
+  uint32_t current = 0;
+  while (true) {
+    const Node &node = nodes[current];
+    if (node.count > 0) {
+      for (uint32_t i = node.first; i < node.first + node.count; i++) {
+        const Triangle &tri = triangles[i];
+        double area = side(tri.a, tri.b, tri.c);
+        if (area == 0) {
+          continue; // edge on from above, its neighbors cover it
+        }
+        // a point right on an edge or corner belongs to one side of it only,
+        // as if nudged a hair towards +z (then -x), so a ray through a
+        // shared edge or vertex crosses exactly one of the triangles
+        auto owns = [&](const glm::vec3 &p, const glm::vec3 &q, double e) {
+          glm::vec2 d(q.x - p.x, q.z - p.z);
+          if (area < 0) {
+            e = -e;
+            d = -d;
+          }
+          return e > 0 || (e == 0 && (d.x > 0 || (d.x == 0 && d.y < 0)));
+        };
+        double eA = side(tri.b, tri.c, point), eB = side(tri.c, tri.a, point),
+               eC = side(tri.a, tri.b, point);
+        if (!owns(tri.b, tri.c, eA) || !owns(tri.c, tri.a, eB) ||
+            !owns(tri.a, tri.b, eC)) {
+          continue;
+        }
+        // the barycentric weights are the edge functions over the area
+        float y = (float)((eA * tri.a.y + eB * tri.b.y + eC * tri.c.y) / area);
+        if (y > point.y) {
+          visit(y - point.y);
+        }
+      }
+    } else {
+      uint32_t left = current + 1, right = node.first;
+      bool goLeft = reaches(nodes[left]), goRight = reaches(nodes[right]);
+      if (goLeft || goRight) {
+        if (goLeft && goRight) {
+          stack[size++] = right;
+        }
+        current = goLeft ? left : right;
+        continue;
+      }
+    }
+    if (size == 0) {
+      return;
+    }
+    current = stack[--size];
+  }
+}
+
+void TriangleBVH::crossings(const glm::vec3 &point, vector<float> &ts) const {
+  ts.clear();
+  traverseUp(point, [&](float t) { ts.push_back(t); });
+}
+
+bool TriangleBVH::inside(const glm::vec3 &point) const {
+  int crossings = 0;
+  traverseUp(point, [&](float) { crossings++; });
+  return crossings % 2 == 1;
+}
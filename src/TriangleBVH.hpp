@@ -0,0 +1,85 @@
+#pragma once
+
+#include "HeightField.hpp"
+#include "ofMain.h"
+#include <span>
+
+// Triangles in world units, three indices each. What the simulation collides
+// with when it's given more than a height field (see
+// Simulation::setCollisionMesh).
+struct TriangleMesh {
+  vector<glm::vec3> vertices;
+  vector<uint32_t> indices;
+
+  bool empty() const { return indices.empty(); }
+  // two triangles per cell, split like Terrain's tiles
+  static TriangleMesh fromHeightField(const HeightField &heightField);
+};
+
+// Bounding volume hierarchy over a triangle mesh for point queries (nearest
+// surface, inside or not) against arbitrary geometry (overhangs, caves,
+// imported seabeds), logarithmic in the triangle count. Built top down with
+// binned SAH splits, then stored flat in depth first order: 32 byte nodes
+// whose left child is the next node, and the triangles reordered so every
+// leaf's are contiguous. Corners are kept exactly as the mesh had them, so
+// neighbors agree on their shared edges (see inside). Read only once built,
+// any number of threads can query it at once.
+class TriangleBVH {
+public:
+  static constexpr int SAH_BINS = 16;
+  static constexpr int MAX_LEAF = 4; // triangles, a leaf never holds more
+  static constexpr uint32_t NONE = ~0u;
+
+  struct Hit {
+    float t = 0;
+    glm::vec3 point = glm::vec3(0, 0, 0);
+    glm::vec3 normal = glm::vec3(0, 0, 0); // unit
+    uint32_t triangle = NONE; // index into the mesh's triangles, NONE = none
+  };
+
+  void build(const TriangleMesh &mesh);
+  void build(std::span<const glm::vec3> vertices,
+             std::span<const uint32_t> indices);
+  void clear();
+
+  bool empty() const { return nodes.empty(); }
+  int numTriangles() const { return triangles.size(); }
+  int numNodes() const { return nodes.size(); }
+
+  // the closest point of any triangle within maxDistance of point. hit.t is
+  // the distance, hit.normal points from the surface towards point
+  bool nearest(const glm::vec3 &point, float maxDistance, Hit &hit) const;
+
+  // under an odd number of surfaces, i.e. inside the solid for meshes that
+  // are closed or open only towards the bottom (a seabed); doesn't depend on
+  // which way the triangles are wound. Watertight: straight up through a
+  // shared edge or vertex counts one surface, not one per triangle
+  bool inside(const glm::vec3 &point) const;
+  // how far above point every surface straight above it is, unsorted, into
+  // ts (cleared first). Tells inside() for every point up the column at once.
+  void crossings(const glm::vec3 &point, vector<float> &ts) const;
+
+private:
+  struct alignas(32) Node {
+    glm::vec3 boundsMin;
+    uint32_t first; // leaf: first triangle, interior: the right child
+    glm::vec3 boundsMax;
+    uint32_t count; // leaf: triangles, 0 for interior nodes
+  };
+  struct Triangle {
+    glm::vec3 a, b, c;
+  };
+  struct BuildRef; // a triangle's bounds and centroid while building
+
+  uint32_t buildNode(vector<BuildRef> &refs, int begin, int end, int depth,
+                     std::span<const glm::vec3> vertices,
+                     std::span<const uint32_t> indices);
+  // every surface straight above point, in no particular order, with the
+  // half open edge rule inside() relies on. visit(t) gets how far up.
+  template <class Visit>
+  void traverseUp(const glm::vec3 &point, Visit &&visit) const;
+
+  vector<Node> nodes;
+  vector<Triangle> triangles;
+  vector<uint32_t> original; // triangles[i] is the mesh's original[i]-th
+};
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Lock-free single producer / single consumer handoff. The producer fills
+// writeBuffer() and publish()es it, the consumer calls update() to grab the
+// newest published value and reads it through readBuffer(). Neither side
+// ever waits on the other; the consumer just skips values it was too slow
+// to see.
+template <typename T> class TripleBuffer {
+public:
+  // producer side
+  T &writeBuffer() { return buffers[writeIndex]; }
+  void publish() {
+    uint8_t old = middle.exchange(writeIndex | FRESH, std::memory_order_acq_rel);
+    writeIndex = old & INDEX_MASK;
+  }
+
+  // consumer side, returns true if there was something new
+  bool update() {
+    if (!(middle.load(std::memory_order_relaxed) & FRESH)) {
+      return false;
+    }
+    uint8_t old = middle.exchange(readIndex, std::memory_order_acq_rel);
+    readIndex = old & INDEX_MASK;
+    return true;
+  }
+  const T &readBuffer() const { return buffers[readIndex]; }
+  T &readBuffer() { return buffers[readIndex]; }
+
+private:
+  static constexpr uint8_t FRESH = 4;
+  static constexpr uint8_t INDEX_MASK = 3;
+
+  T buffers[3];
+  uint8_t writeIndex = 0;
+  uint8_t readIndex = 1;
+  std::atomic<uint8_t> middle{2};
+};
@@ -0,0 +1,94 @@
+#include "ViewCuller.hpp"
+
+void ViewCuller::setup(const Settings &settings) {
+  this->settings = settings;
+  cellSize = (settings.boundsMax - settings.boundsMin) /
+             glm::vec3(CELLS_XZ, CELLS_Y, CELLS_XZ);
+  invCellSize = 1.0f / cellSize;
+  // nothing culled until the first update()
+  for (auto &plane : planes) {
+    plane = glm::vec4(0, 0, 0, 1);
+  }
+  std::fill(std::begin(cellDetail), std::end(cellDetail), MIXED);
+}
+
+void ViewCuller::update(const glm::mat4 &viewProjection,
+                        const glm::vec3 &eye) {
+  this->eye = eye;
+
+  // Gribb / Hartmann: each plane is the last row of the matrix plus or minus
+  // one of the others
+  auto row = [&](int r) {
+    return glm::vec4(viewProjection[0][r], viewProjection[1][r],
+                     viewProjection[2][r], viewProjection[3][r]);
+  };
+  for (int axis = 0; axis < 3; axis++) {
+    planes[axis * 2] = row(3) + row(axis);
+    planes[axis * 2 + 1] = row(3) - row(axis);
+  }
+  for (auto &plane : planes) {
+    plane /= glm::length(glm::vec3(plane));
+  }
+
+  float margin = settings.boidRadius * MAX_SIZE;
+  float lod2 = settings.lodDistance * settings.lodDistance;
+  for (int z = 0; z < CELLS_XZ; z++) {
+    for (int y = 0; y < CELLS_Y; y++) {
+      for (int x = 0; x < CELLS_XZ; x++) {
+        // the cell grown by the biggest boid radius, anything centered in it
+        // is inside this box
+        glm::vec3 lo = settings.boundsMin + glm::vec3(x, y, z) * cellSize;
+        glm::vec3 hi = lo + cellSize;
+        lo -= margin;
+        hi += margin;
+
+        bool inside = true, outside = false;
+        for (auto &plane : planes) {
+          glm::vec3 n(plane);
+          // corners furthest along / against the normal
+          glm::vec3 far(n.x > 0 ? hi.x : lo.x, n.y > 0 ? hi.y : lo.y,
+                        n.z > 0 ? hi.z : lo.z);
+          glm::vec3 close(n.x > 0 ? lo.x : hi.x, n.y > 0 ? lo.y : hi.y,
+                          n.z > 0 ? lo.z : hi.z);
+          if (glm::dot(n, far) + plane.w < 0) {
+            outside = true;
+            break;
+          }
+          if (glm::dot(n, close) + plane.w < 0) {
+            inside = false;
+          }
+        }
+
+        uint8_t &detail = cellDetail[(z * CELLS_Y + y) * CELLS_XZ + x];
+        if (outside) {
+          detail = HIDDEN;
+          continue;
+        }
+        // closest and furthest the cell gets from the eye, the centers are
+        // in the unpadded box
+        lo += margin;
+        hi -= margin;
+        glm::vec3 nearest = glm::clamp(eye, lo, hi);
+        glm::vec3 furthest = glm::max(glm::abs(eye - lo), glm::abs(eye - hi));
+        float nearest2 = glm::dot(eye - nearest, eye - nearest);
+        float furthest2 = glm::dot(furthest, furthest);
+        if (!inside || (nearest2 < lod2 && furthest2 >= lod2)) {
+          detail = MIXED;
+        } else {
+          detail = furthest2 < lod2 ? NEAR : FAR;
+        }
+      }
+    }
+  }
+}
+
+ViewCuller::Detail ViewCuller::test(const glm::vec3 &center,
+                                    float radius) const {
+  for (auto &plane : planes) {
+    if (glm::dot(glm::vec3(plane), center) + plane.w < -radius) {
+      return HIDDEN;
+    }
+  }
+  float distance2 = glm::dot(center - eye, center - eye);
+  return distance2 < settings.lodDistance * settings.lodDistance ? NEAR : FAR;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "ofMain.h"
+
+// Decides per boid whether the camera sees it and whether it's close enough
+// to deserve the full mesh. The boids' box (see SpatialGrid) is cut into a
+// fixed lattice of cells and each cell is tested against the frustum and the
+// LOD distance once per frame, so most boids only cost a cell lookup; only
+// the ones in cells that straddle a plane or the LOD distance get tested on
+// their own.
+class ViewCuller {
+public:
+  enum Detail : uint8_t { HIDDEN, NEAR, FAR };
+
+  struct Settings {
+    float lodDistance = 200; // world units, past it boids are drawn as impostors
+    float boidRadius = 5;    // bounding radius of a boid drawn at size 1
+    // the box the boids live in, same as SpatialGrid's
+    glm::vec3 boundsMin = glm::vec3(-375, -100, -375);
+    glm::vec3 boundsMax = glm::vec3(375, 0, 375);
+  };
+
+  static constexpr int CELLS_XZ = 16, CELLS_Y = 4;
+  // largest BoidKindTraits::drawSize (predators are drawn twice as big), the
+  // cells are padded by that many boid radii
+  static constexpr float MAX_SIZE = 2;
+
+  void setup(const Settings &settings);
+  // viewProjection maps world to clip space (OpenGL convention), eye is the
+  // camera position in world units
+  void update(const glm::mat4 &viewProjection, const glm::vec3 &eye);
+
+  // for a boid at position drawn at size (scales boidRadius)
+  Detail classify(const glm::vec3 &position, float size) const {
+    int cell = cellOf(position);
+    if (cell >= 0 && cellDetail[cell] != MIXED) {
+      return (Detail)cellDetail[cell];
+    }
+    return test(position, settings.boidRadius * size);
+  }
+
+  const Settings &getSettings() const { return settings; }
+
+private:
+  static constexpr uint8_t MIXED = 3; // cell needs a test per boid
+
+  int cellOf(const glm::vec3 &p) const {
+    glm::vec3 c = (p - settings.boundsMin) * invCellSize;
+    if (c.x < 0 || c.y < 0 || c.z < 0 || c.x >= CELLS_XZ || c.y >= CELLS_Y ||
+        c.z >= CELLS_XZ) {
+      return -1; // outside the box, tested on its own
+    }
+    return ((int)c.z * CELLS_Y + (int)c.y) * CELLS_XZ + (int)c.x;
+  }
+  Detail test(const glm::vec3 &center, float radius) const;
+
+  Settings settings;
+  glm::vec3 cellSize = glm::vec3(1, 1, 1);
+  glm::vec3 invCellSize = glm::vec3(1, 1, 1);
+  glm::vec4 planes[6]; // xyz = inward normal, w = distance, normalized
+  glm::vec3 eye = glm::vec3(0, 0, 0);
+  uint8_t cellDetail[CELLS_XZ * CELLS_Y * CELLS_XZ] = {};
+};
@@ -2,7 +2,7 @@
 #include "ofApp.h"
 
 //========================================================================
-int main( ){
+int main(int argc, char *argv[]){
 
 #ifdef OF_TARGET_OPENGLES
 	ofGLESWindowSettings settings;
@@ -14,7 +14,22 @@ int main( ){
 
 	auto window = ofCreateWindow(settings);
 
-	ofRunApp(window, std::make_shared<ofApp>());
+	auto app = std::make_shared<ofApp>();
+	// --record FILE writes the session's inputs for boidsBench --replay,
+	// --cpu-particles runs the volcano without the compute shader,
+	// --collision-mesh FILE (in bin/data) is drawn and collided with instead of
+	// the terrain
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--record" && i + 1 < argc) {
+			app->recordPath = argv[++i];
+		} else if (arg == "--cpu-particles") {
+			app->cpuParticles = true;
+		} else if (arg == "--collision-mesh" && i + 1 < argc) {
+			app->collisionMeshPath = argv[++i];
+		}
+	}
+	ofRunApp(window, app);
 	ofRunMainLoop();
 
 }
@@ -18,83 +18,8 @@
 #include "ofVboMesh.h"
 #include <concepts>
 #include <cstdlib>
+#include <numeric>
 
-float calculateOctaveHeight(float amplitude, float frequency, int nOctaves,
-                            float x, float y) {
-  float height = 0;
-  for (int i = 0; i < nOctaves; i++) {
-    height += ofNoise(x * frequency, y * frequency) * amplitude;
-    amplitude *= 0.5;
-    frequency *= 1.5;
-  }
-  return height;
-}
-void ofApp::generatePerlinNoiseMesh() {
-  // Generate a grid of vertices
-  int width = 50;
-  int depth = 50;
-  customMesh.clear();
-  int numX = (width) * 2; // for 0.5 steps
-  int numZ = (depth) * 2;
-  heightMap.resize(numZ, std::vector<float>(numX, 0.0f));
-  // here we make the points inside our mesh
-  // add one vertex to the mesh across our width and height
-  // we use these x and y values to set the x and y co-ordinates of the mesh,
-  // adding a z value of zero to complete the 3d location of each vertex
-  int w = 0;
-  int d = 0;
-  int maxHeightPosX = -1;
-  int maxHeightPosZ = -1;
-  float maxHeight = -99999;
-  for (float y = 0; y < depth; y += 0.5, ++w) {
-    d = 0;
-    for (float x = 0; x < width; x += 0.5, ++d) {
-      float rawHeight =
-          calculateOctaveHeight(amplitude, frequency, octaves, x, y);
-      float height =
-          (rawHeight - octaves) * 2.0f * amplitude; // Center and scale
-      customMesh.addVertex(ofPoint(x - width / 2., height,
-                                   y - depth / 2.)); // mesh index = x + y*width
-      // this replicates the pixel array within the camera bitmap...
-      // Calculate correct texture coordinates
-      float u = x / (width - 1);
-      float v = y / (depth - 1);
-      u = ofClamp(u, 0.0, 1.0);
-      v = ofClamp(v, 0.0, 1.0);
-      heightMap[w][d] = height * scale; // Store height for (x, z)
-      if (height * scale > maxHeight) {
-        maxHeight = height * scale;
-        maxHeightPosX = w;
-        maxHeightPosZ = d;
-      }
-      customMesh.addTexCoord(glm::vec2(u, v)); // add texture coordinates
-    }
-  }
-  // pECenterx = maxHeightPosX;
-  // pECenterz = maxHeightPosZ;
-  // pECentery = maxHeight + 20;
-  // // from:
-  // //
-  // https://github.com/uwe-creative-technology/CT_toolkit_sessions/blob/master/meshExample/src/ofApp.cpp
-  // // here we loop through and join the vertices together as indices to make
-  // rows
-  // // of triangles to make the wireframe grid
-  for (int y = 0; y < d - 1; y++) {
-    for (int x = 0; x < w - 1; x++) {
-      customMesh.addIndex(x + y * w);       // 0
-      customMesh.addIndex((x + 1) + y * w); // 1
-      customMesh.addIndex(x + (y + 1) * w); // 10
-
-      customMesh.addIndex((x + 1) + y * w);       // 1
-      customMesh.addIndex((x + 1) + (y + 1) * w); // 11
-      customMesh.addIndex(x + (y + 1) * w);       // 10
-    }
-  }
-  for (auto face : customMesh.getUniqueFaces()) {
-
-    customMesh.addNormal(face.getFaceNormal());
-  }
-}
 //--------------------------------------------------------------
 void ofApp::setup() {
   ofDisableArbTex();
@@ -102,6 +27,7 @@ void ofApp::setup() {
     cout << "gls3" << endl;
     mainShader.load("shadersGL3/mainShader");
     debugShader.load("shadersGL3/debugShader");
+    instancedShader.load("shadersGL3/instanced");
   } else {
     cout << "gls2" << endl;
   }
@@ -133,32 +59,56 @@ void ofApp::setup() {
   gui.add(showMeshCollision.setup("Mesh Collisions", true));
   gui.add(showHealth.setup("Mesh Collisions", true));
   gui.add(showVolcano.setup("Show Volcano", true));
-  // setting up compute shader
-  compute.setupShaderFromFile(GL_COMPUTE_SHADER, "particleCompute.glsl");
-  compute.linkProgram();
-  particles.resize(1024);
+  // setting up compute shader, the CPU does its job where there are none
+  if (!cpuParticles && !hasComputeShaders()) {
+    cout << "no compute shaders, volcano particles run on the CPU" << endl;
+    cpuParticles = true;
+  }
+  if (cpuParticles) {
+    particleThreads = std::make_unique<ThreadPool>();
+  } else {
+    compute.setupShaderFromFile(GL_COMPUTE_SHADER, "particleCompute.glsl");
+    compute.linkProgram();
+  }
+  // a new seed every run, a --record file keeps it (see Replay)
+  uint64_t seed = std::chrono::steady_clock::now().time_since_epoch().count();
+  cout << "simulation seed " << seed << endl;
+  sim.setSeed(seed);
+  if (!recordPath.empty() && !sim.record(recordPath)) {
+    cout << "problem with recording to " << recordPath << endl;
+  }
   scale = 15;
-  for (auto &p : particles) {
-    p.pos.x = pECenterx;
-    p.pos.y = pECentery;
-    p.pos.z = pECenterz;
-    p.pos.w = ofRandom(3);
-    p.vel = {ofRandom(-5, 5), 10, ofRandom(-5, 5), 0};
-    // p.pos = glm::vec4(pECenterx, pECentery, pECenterz, 1.0f);
-    // p.vel = {0.1, 10.0, 0.1, 0.0};
-    p.col = {1.0, 1.0, 1.0, 1.0};
-    // p.vel = {0,0,0,0};
+  // the stream after the flocks' (see Simulation::setSeed)
+  Rng particleRng(seed, Simulation::NUM_FLOCKS);
+  if (cpuParticles) {
+    setupParticleSystem(particleRng.at(0));
+    // the pool is uploaded as is every frame, dead slots have alpha 0
+    for (auto &buffer : particleBuffers) {
+      buffer.allocate(CPU_PARTICLES * sizeof(Particle), GL_DYNAMIC_DRAW);
+    }
+  } else {
+    particles.resize(1024);
+    for (auto &p : particles) {
+      p.pos.x = pECenterx;
+      p.pos.y = pECentery;
+      p.pos.z = pECenterz;
+      p.pos.w = particleRng.uniform(PARTICLE_LIFE_TIME);
+      float vx = particleRng.uniform(-5, 5);
+      float vz = particleRng.uniform(-5, 5);
+      p.vel = {vx, 10, vz, 0};
+      // p.pos = glm::vec4(pECenterx, pECentery, pECenterz, 1.0f);
+      // p.vel = {0.1, 10.0, 0.1, 0.0};
+      p.col = {1.0, 1.0, 1.0, 1.0};
+      // p.vel = {0,0,0,0};
+    }
+    // setting up the buffers and the vbo. The job of the vbo is to draw on
+    // screen.
+    for (auto &buffer : particleBuffers) {
+      buffer.allocate(particles, GL_DYNAMIC_DRAW);
+    }
   }
-  // setting up the buffers and the vbo. The job of the vbo is to draw on
-  // screen.
-  particlesBuffer.allocate(particles, GL_DYNAMIC_DRAW);
-  particlesBuffer2.allocate(particles, GL_DYNAMIC_DRAW);
-
-  vbo.setVertexBuffer(particlesBuffer, 4, sizeof(Particle));
-  vbo.setColorBuffer(particlesBuffer, sizeof(Particle), sizeof(glm::vec4) * 2);
-
-  particlesBuffer.bindBase(GL_SHADER_STORAGE_BUFFER, 0);
-  particlesBuffer2.bindBase(GL_SHADER_STORAGE_BUFFER, 1);
+  currentParticles = 1;
+  swapParticleBuffers();
 
   cam.setDistance(2);
   cam.setNearClip(0.1);
@@ -171,9 +121,11 @@ void ofApp::setup() {
   light.setDiffuseColor(ofFloatColor(1.0, 0.8, 0.8));
   light.setAmbientColor(ofFloatColor(0.4));
 
-  ofFile f2;
-  f2.open("water_plane.ply", ofFile::ReadOnly);
-  waterPlane.load(f2);
+  // meshes come out of bin/data/cache after the first run
+  meshCache.setDirectory(ofToDataPath("cache"));
+  if (!meshCache.loadMesh("water_plane.ply", waterPlane)) {
+    cout << "problem with loading water plane" << endl;
+  }
 
   ofFile s_box;
   s_box.open("skybox.png", ofFile::ReadOnly);
@@ -184,22 +136,36 @@ void ofApp::setup() {
   if (!rockImage.load("rock_or_grass.jpg")) {
     cout << "problem with loading roock texture" << endl;
   }
-  if (!model.load("fish.obj")) {
+  if (!meshCache.loadMesh("fish.obj", fishMesh)) {
     cout << "problem with loading fish model" << endl;
   }
+  fishInstances.setup(fishMesh);
+  fishImpostors.setup(InstancedMesh::impostor(fishMesh));
+  foodInstances.setup(ofMesh::sphere(1, 12, OF_PRIMITIVE_TRIANGLES));
+  foodImpostors.setup(ofMesh::sphere(1, 4, OF_PRIMITIVE_TRIANGLES));
+
+  ViewCuller::Settings cullSettings;
+  cullSettings.boidRadius = 0;
+  for (auto &v : fishMesh.getVertices()) {
+    cullSettings.boidRadius = std::max(cullSettings.boidRadius, glm::length(v));
+  }
+  culler.setup(cullSettings);
   //                                           0);
 
-  generatePerlinNoiseMesh();
+  Terrain::Settings terrainSettings;
+  terrainSettings.scale = scale;
+  terrainSettings.cacheDirectory = ofToDataPath("cache/terrain");
+  terrain.setup(terrainParams(), terrainSettings);
 
   // flock thing  // vbo.disableColors();s
-  flock.type = "prey";
-  flock.generateFlock(10);
+  sim.flock.kind = BoidKind::PREY;
+  sim.spawn(Simulation::PREY, 10);
   // setup predators
 
-  predators.type = "predator";
-  predators.generateFlock(10);
-  food.type = "food";
-  food.generateFlock(10);
+  sim.predators.kind = BoidKind::PREDATOR;
+  sim.spawn(Simulation::PREDATORS, 10);
+  sim.food.kind = BoidKind::FOOD;
+  sim.spawn(Simulation::FOOD, 10);
   // for (auto &predator : predators) {
   //   predator.fishColor = ofColor::red;
   //   predator.maxSpeed = 0.2;
@@ -207,6 +173,24 @@ void ofApp::setup() {
   // }
 
   boundingBox.set(750, 200, 750);
+
+  if (!collisionMeshPath.empty()) {
+    if (meshCache.loadMesh(collisionMeshPath, collisionMesh)) {
+      sim.setCollisionMesh(collisionTriangles(collisionMesh, scale));
+    } else {
+      cout << "problem with loading collision mesh " << collisionMeshPath
+           << endl;
+    }
+  }
+
+  sim.setParams(simulationParams());
+  sim.setHeightField(terrain.getHeightField());
+  sim.start();
+}
+
+void ofApp::exit() {
+  sim.stop();
+  terrain.stop();
 }
 void ofApp::renderScene() {
   ofSetColor(255);
@@ -242,7 +226,8 @@ void ofApp::renderScene() {
   mainShader.setUniformTexture("grassTexture", grassImage, 0);
   mainShader.setUniformTexture("rockTexture", rockImage, 1);
 
-  customMesh.draw();
+  terrain.draw();
+  collisionMesh.draw();
 
   // model = glm::mat4(1.0) * glm::scale(glm::vec3(150, 150, 150));
   // mainShader.setUniformMatrix4f("model", model);
@@ -257,12 +242,30 @@ void ofApp::renderScene() {
   ofDrawSphere(light.getPosition(), 0.1);
 
   skybox.draw();
-  // prey
-  flock.draw(predators.boids, food.boids, heightMap);
-  // predators
-  predators.draw(emptyBoids, flock.boids, heightMap);
-  // drawing food
-  food.draw(flock.boids, emptyBoids, heightMap);
+  // the simulation runs on its own thread, draw its newest state
+  float alpha;
+  const Simulation::Snapshot &snapshot = sim.latestSnapshot(alpha);
+  // only what's in view, full meshes up close and impostors further out, one
+  // instanced draw for each
+  culler.update(cam.getModelViewProjectionMatrix(), cam.getPosition());
+  instancedShader.begin();
+  sim.flock.packInstances(snapshot.prey, alpha, culler, instances,
+                          farInstances);
+  fishInstances.draw(instances);
+  fishImpostors.draw(farInstances);
+  sim.predators.packInstances(snapshot.predators, alpha, culler, instances,
+                              farInstances);
+  fishInstances.draw(instances);
+  fishImpostors.draw(farInstances);
+  sim.food.packInstances(snapshot.food, alpha, culler, instances,
+                         farInstances);
+  foodInstances.draw(instances);
+  foodImpostors.draw(farInstances);
+  instancedShader.end();
+
+  Boid::Features features = overlayFeatures();
+  sim.flock.drawOverlays(snapshot.prey, alpha, features);
+  sim.predators.drawOverlays(snapshot.predators, alpha, features);
 
   boundingBox.drawWireframe();
   cam.end();
@@ -271,19 +274,143 @@ void ofApp::renderScene() {
 //--------------------------------------------------------------
 void ofApp::update() {
   ofEnableDepthTest();
-  generatePerlinNoiseMesh();
-  compute.begin();
-  // cout << pECenterx << endl;
-  compute.setUniform1f("emitterX", pECenterx);
-  compute.setUniform1f("emitterY", pECentery);
-  compute.setUniform1f("emitterZ", pECenterz);
-  compute.setUniform1f("emitterR", pECenterRadius);
-
-  compute.dispatchCompute((particles.size() + 1024 - 1) / 1024, 1, 1);
-  compute.end();
-  particlesBuffer.copyTo(particlesBuffer2);
-  particlesBuffer2.copyTo(particlesBuffer);
+  // tiles are built on the terrain's own thread, only when missing or when a
+  // terrain slider moved
+  terrain.setParams(terrainParams());
+  if (terrain.update(cam.getPosition())) {
+    sim.setHeightField(terrain.getHeightField());
+  }
+  // the real frame time, but no huge leaps after a stall
+  float dt = std::min((float)ofGetLastFrameTime(), 0.1f);
+  if (cpuParticles) {
+    ParticleSystem::Emitter &volcano =
+        particleSystem.getEmitter(volcanoEmitter);
+    volcano.position = glm::vec3(pECenterx, pECentery, pECenterz);
+    volcano.radius = pECenterRadius;
+    particleSystem.update(dt, *particleThreads);
+    // into the buffer that isn't being drawn from
+    particleBuffers[1 - currentParticles].updateData(
+        0, particleSystem.getUsed() * sizeof(Particle),
+        particleSystem.getParticles());
+    particleOrder.sort(particleSystem.getParticles(),
+                       particleSystem.getAlive(), cam.getModelViewMatrix(),
+                       *particleThreads);
+    const vector<uint32_t> &order = particleOrder.getOrder();
+    vbo.setIndexData(order.data(), order.size(), GL_STREAM_DRAW);
+  } else {
+    // the shader reads p2 (binding 1) and writes p (binding 0)
+    particleBuffers[currentParticles].bindBase(GL_SHADER_STORAGE_BUFFER, 1);
+    particleBuffers[1 - currentParticles].bindBase(GL_SHADER_STORAGE_BUFFER,
+                                                   0);
+    compute.begin();
+    // cout << pECenterx << endl;
+    compute.setUniform1f("emitterX", pECenterx);
+    compute.setUniform1f("emitterY", pECentery);
+    compute.setUniform1f("emitterZ", pECenterz);
+    compute.setUniform1f("emitterR", pECenterRadius);
+    compute.setUniform1f("dt", dt);
+    compute.setUniform1f("maxLifeTime", PARTICLE_LIFE_TIME);
+    compute.setUniform1i("count", particles.size());
+
+    compute.dispatchCompute((particles.size() + PARTICLE_GROUP_SIZE - 1) /
+                                PARTICLE_GROUP_SIZE,
+                            1, 1);
+    compute.end();
+    // the point draw reads what the shader wrote
+    glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+  }
+  swapParticleBuffers();
+
+  sim.setParams(simulationParams());
+}
+
+//--------------------------------------------------------------
+// particleCompute.glsl needs GL 4.3 or the extension, the window asks for 3.2
+bool ofApp::hasComputeShaders() {
+  GLint major = 0, minor = 0;
+  glGetIntegerv(GL_MAJOR_VERSION, &major);
+  glGetIntegerv(GL_MINOR_VERSION, &minor);
+  return major > 4 || (major == 4 && minor >= 3) ||
+         ofGLCheckExtension("GL_ARB_compute_shader");
+}
 
+//--------------------------------------------------------------
+// the CPU path's emitters: the volcano, bubbles and sediment around it
+void ofApp::setupParticleSystem(uint64_t seed) {
+  particleSystem.setup(CPU_PARTICLES, seed);
+
+  ParticleSystem::Emitter volcano; // what particleCompute.glsl does
+  volcano.position = glm::vec3(pECenterx, pECentery, pECenterz);
+  volcano.rate = 1024 / PARTICLE_LIFE_TIME;
+  volcano.minLifeTime = volcano.maxLifeTime = PARTICLE_LIFE_TIME;
+  volcanoEmitter = particleSystem.addEmitter(volcano);
+
+  ParticleSystem::Emitter bubbles; // rising slowly, speeding up
+  bubbles.position = glm::vec3(pECenterx, pECentery - 40, pECenterz);
+  bubbles.radius = 30;
+  bubbles.rate = 400;
+  bubbles.minLifeTime = 2;
+  bubbles.maxLifeTime = 5;
+  bubbles.minVelocity = glm::vec3(-1, 2, -1);
+  bubbles.maxVelocity = glm::vec3(1, 6, 1);
+  bubbles.forces.acceleration = glm::vec3(0, 3, 0);
+  bubbles.forces.colors[0] = ofFloatColor(0.8, 0.9, 1);
+  bubbles.forces.colors[1] = ofFloatColor(0.5, 0.7, 1);
+  bubbles.forces.colors[2] = ofFloatColor(0.3, 0.5, 0.9);
+  particleSystem.addEmitter(bubbles);
+
+  ParticleSystem::Emitter sediment; // drifting down over a wide area
+  sediment.position = glm::vec3(pECenterx, pECentery + 60, pECenterz);
+  sediment.radius = 150;
+  sediment.rate = 2000;
+  sediment.minLifeTime = 6;
+  sediment.maxLifeTime = 12;
+  sediment.minVelocity = glm::vec3(-0.5, -2, -0.5);
+  sediment.maxVelocity = glm::vec3(0.5, -1, 0.5);
+  sediment.forces.acceleration = glm::vec3(0, -0.2, 0);
+  sediment.forces.colors[0] = ofFloatColor(0.6, 0.5, 0.35);
+  sediment.forces.colors[1] = ofFloatColor(0.45, 0.35, 0.25);
+  sediment.forces.colors[2] = ofFloatColor(0.3, 0.25, 0.2);
+  particleSystem.addEmitter(sediment);
+}
+
+//--------------------------------------------------------------
+// mesh units to world units, unindexed meshes are a triangle per 3 vertices
+TriangleMesh ofApp::collisionTriangles(const ofMesh &mesh, float scale) {
+  TriangleMesh triangles;
+  triangles.vertices.reserve(mesh.getNumVertices());
+  for (auto &v : mesh.getVertices()) {
+    triangles.vertices.push_back(v * scale);
+  }
+  if (mesh.hasIndices()) {
+    triangles.indices.assign(mesh.getIndices().begin(),
+                             mesh.getIndices().end());
+  } else {
+    triangles.indices.resize(mesh.getNumVertices() / 3 * 3);
+    std::iota(triangles.indices.begin(), triangles.indices.end(), 0);
+  }
+  return triangles;
+}
+
+//--------------------------------------------------------------
+void ofApp::swapParticleBuffers() {
+  currentParticles = 1 - currentParticles;
+  ofBufferObject &current = particleBuffers[currentParticles];
+  vbo.setVertexBuffer(current, 4, sizeof(Particle));
+  vbo.setColorBuffer(current, sizeof(Particle), sizeof(glm::vec4) * 2);
+}
+
+//--------------------------------------------------------------
+Terrain::Params ofApp::terrainParams() {
+  Terrain::Params params;
+  params.noise.amplitude = amplitude;
+  params.noise.frequency = frequency;
+  params.noise.octaves = octaves;
+  return params;
+}
+
+//--------------------------------------------------------------
+Simulation::Params ofApp::simulationParams() {
   Boid::BoidParams params;
   params.preyMaxSpeed = preyMaxSpeed;
   params.preyMaxForce = preyMaxForce;
@@ -295,14 +422,17 @@ void ofApp::update() {
   params.separationRadius = separationRadius;
   params.alignmentRadius = alignmentRadius;
   params.cohesionRadius = cohesionRadius;
+  return {params};
+}
+
+//--------------------------------------------------------------
+Boid::Features ofApp::overlayFeatures() {
   Boid::Features features;
   features.enableCollisionRays = enableCollisionRays;
   features.enableSeekFoodPoint = enableSeekFoodPoint;
   features.showMeshCollision = showMeshCollision;
   features.showHealth = showHealth;
-  flock.update(params, features);
-  predators.update(params, features);
-  food.update(params, features);
+  return features;
 }
 
 //--------------------------------------------------------------
@@ -316,7 +446,15 @@ void ofApp::draw() {
 
   if (showVolcano) {
     glPointSize(10.0f);                       // Set to your desired size
-    vbo.draw(GL_POINTS, 0, particles.size()); // drawing particles
+    if (cpuParticles) {
+      // only the living ones, back to front, so they blend over each other
+      // instead of hiding what's behind them
+      glDepthMask(GL_FALSE);
+      vbo.drawElements(GL_POINTS, particleOrder.getOrder().size());
+      glDepthMask(GL_TRUE);
+    } else {
+      vbo.draw(GL_POINTS, 0, particles.size()); // drawing particles
+    }
     ofDrawSphere(pECenterx, pECentery, pECenterz, 1);
   }
 
@@ -339,15 +477,15 @@ void ofApp::keyPressed(int key) {
   }
   if (key == 'f') {
     cout << "food " << endl;
-    food.generateFlock(10);
+    sim.spawn(Simulation::FOOD, 10);
   }
   if (key == 'b') {
     std::cout << "boids" << std::endl;
-    flock.generateFlock(10);
+    sim.spawn(Simulation::PREY, 10);
   }
   if (key == 'p') {
     std::cout << "predators" << std::endl;
-    predators.generateFlock(10);
+    sim.spawn(Simulation::PREDATORS, 10);
   }
 }
 
@@ -14,7 +14,14 @@
 #include "ofxSlider.h"
 #include <vector>
 
+#include "DepthSort.hpp"
 #include "Flock.hpp"
+#include "InstancedMesh.hpp"
+#include "MeshCache.hpp"
+#include "ParticleSystem.hpp"
+#include "Simulation.hpp"
+#include "Terrain.hpp"
+#include "ThreadPool.hpp"
 #include "ofxToggle.h"
 
 class ofApp : public ofBaseApp {
@@ -22,6 +29,7 @@ public:
   void setup();
   void update();
   void draw();
+  void exit();
 
   void keyPressed(int key);
   void keyReleased(int key);
@@ -35,18 +43,24 @@ public:
   void renderDepthMap();
   void renderScene();
   void renderScene(ofShader &shader);
-  void generatePerlinNoiseMesh(); // generate the terrain mesh with a vbomesh
   void loadModel(string filename);
+  Simulation::Params simulationParams(); // current slider values
+  Boid::Features overlayFeatures();      // and toggles, drawn here only
+  Terrain::Params terrainParams();
+  static bool hasComputeShaders();
+  static TriangleMesh collisionTriangles(const ofMesh &mesh, float scale);
+  void setupParticleSystem(uint64_t seed);
+  void swapParticleBuffers(); // the written buffer becomes current
 
   ofShader mainShader;
   ofShader debugShader;
   ofShader compute;
+  ofShader instancedShader; // fish and food, see InstancedMesh
   ofEasyCam cam;
   ofLight light;
   ofMesh terrainMesh;
   ofMesh waterPlane;
   ofCubeMap skybox;
-  ofVboMesh customMesh;
   ofxPanel gui;
   ofxFloatSlider lightPosX;
   ofxFloatSlider lightPosY;
@@ -75,24 +89,41 @@ public:
   ofxToggle showVolcano;
 
 
-  struct Particle { // include lifespan and stuff later
-    glm::vec4 pos;
-    glm::vec4 vel;
-    ofFloatColor col;
-  };
-
-  std::vector<Particle> particles;
+  std::vector<Particle> particles; // see ParticleKernels.hpp
+  static constexpr int PARTICLE_GROUP_SIZE = 256; // particleCompute.glsl's
+  static constexpr float PARTICLE_LIFE_TIME = 3;  // seconds, the shader's
+  // the particles on the CPU instead of particleCompute.glsl, with
+  // --cpu-particles or when the GL context has no compute shaders. Then the
+  // volcano is one of several emitters of particleSystem
+  bool cpuParticles = false;
+  static constexpr int CPU_PARTICLES = 1 << 16;
+  ParticleSystem particleSystem;
+  int volcanoEmitter = 0; // follows the emitter sliders
+  DepthSort particleOrder; // living particles back to front, for blending
+  std::unique_ptr<ThreadPool> particleThreads; // not the simulation's, it
+                                               // would wait on a tick
   ofVbo vbo;
-  ofBufferObject particlesBuffer,
-      particlesBuffer2; // keep track of current pos and vel, and keep track of
-                        // prev pos and vel
+  // ping-pong: the frame reads particleBuffers[currentParticles] and writes
+  // the other one, which then becomes current, vbo draws the current one
+  ofBufferObject particleBuffers[2];
+  int currentParticles = 0;
   ofImage grassImage, rockImage, snowImage;
-  Flock flock, predators, food;
-  ofx::assimp::Model model;
+  Simulation sim; // owns the prey, predator and food flocks
+  std::string recordPath; // where sim records to (see Replay), empty if not
+  // an imported seabed the boids collide with (see TriangleBVH), drawn at the
+  // terrain's scale. Empty = the boids use the terrain's height field
+  std::string collisionMeshPath;
+  ofVboMesh collisionMesh;
+  MeshCache meshCache; // binary copies of the meshes in bin/data
+  ofVboMesh fishMesh;
+  InstancedMesh fishInstances; // prey and predators
+  InstancedMesh fishImpostors; // the same past the culler's LOD distance
+  InstancedMesh foodInstances;
+  InstancedMesh foodImpostors;
+  ViewCuller culler;
+  vector<InstancedMesh::Instance> instances, farInstances; // reused every frame
   std::string mSceneString;
-  std::vector<std::vector<float>> heightMap;
+  Terrain terrain; // streamed noise terrain + heights for collisions
   ofBoxPrimitive boundingBox;
   int scale;
-  
-  std::vector<Boid> emptyBoids;
 };